@@ -4,12 +4,14 @@
 #include <Utf8.hpp>
 #include <stdlib.h>
 #include <iostream>
+#include <algorithm>
 
 using namespace Voxl;
 
 Allocator::Allocator()
 	: m_head(nullptr)
 	, m_tail(nullptr)
+	, m_handleCount(0)
 	, m_bytesAllocated(0)
 	, m_bytesAllocatedAfterWhichTheGcRuns(1024 * 1024)
 {}
@@ -34,12 +36,9 @@ Allocator::~Allocator()
 		freeObj(class_);
 	}
 
-	for (const auto& constant : m_constants)
+	for (const auto obj : m_constantObjs)
 	{
-		if (constant.isObj())
-		{
-			freeObj(constant.as.obj);
-		}
+		freeObj(obj);
 	}
 }
 
@@ -86,6 +85,7 @@ Obj* Allocator::allocateObjConstant(size_t size, ObjType type)
 	obj->type = type;
 	obj->isMarked = true;
 	obj->next = nullptr;
+	m_constantObjs.push_back(obj);
 	return obj;
 }
 
@@ -119,6 +119,53 @@ ObjString* Allocator::allocateString(std::string_view chars, size_t length)
 	return obj;
 }
 
+Obj* Allocator::allocateConcatenation(Obj* left, Obj* right)
+{
+	const auto size = ObjRope::stringSize(left) + ObjRope::stringSize(right);
+	if (size < ObjRope::MIN_SIZE)
+	{
+		std::string chars;
+		chars.reserve(size);
+		const auto append = [&chars](std::string_view piece) { chars += piece; };
+		ObjRope::forEachPiece(left, append);
+		ObjRope::forEachPiece(right, append);
+		return allocateString(chars);
+	}
+
+	auto obj = allocateObj(sizeof(ObjRope), ObjType::Rope)->asRope();
+	obj->left = left;
+	obj->right = right;
+	obj->size = size;
+	obj->flattened = nullptr;
+	return obj;
+}
+
+ObjString* Allocator::flattenRope(ObjRope* rope)
+{
+	if (rope->flattened != nullptr)
+		return rope->flattened;
+
+	std::string chars;
+	chars.reserve(rope->size);
+	ObjRope::forEachPiece(rope, [&chars](std::string_view piece) { chars += piece; });
+	// The pieces are kept alive by the rope until the string is allocated.
+	rope->flattened = allocateString(chars);
+	rope->left = nullptr;
+	rope->right = nullptr;
+	return rope->flattened;
+}
+
+#ifdef VOXL_NAN_BOXING
+
+ObjInt* Allocator::allocateInt(Int value)
+{
+	auto obj = allocateObj(sizeof(ObjInt), ObjType::Int)->asInt();
+	obj->value = value;
+	return obj;
+}
+
+#endif
+
 ObjClosure* Allocator::allocateClosure(ObjFunction* function)
 {
 	auto obj = allocateObj(sizeof(ObjClosure), ObjType::Closure)->asClosure();
@@ -133,14 +180,41 @@ ObjUpvalue* Allocator::allocateUpvalue(Value* localVariable)
 	auto obj = allocateObj(sizeof(ObjUpvalue), ObjType::Upvalue)->asUpvalue();
 	obj->location = localVariable;
 	obj->value = Value::null();
+	obj->next = nullptr;
+	return obj;
+}
+
+ObjShape* Allocator::allocateShape()
+{
+	auto obj = allocateObj(sizeof(ObjShape), ObjType::Shape)->asShape();
+	new (&obj->fieldIndices) HashTable();
+	new (&obj->transitions) HashTable();
+	obj->fieldCount = 0;
+	return obj;
+}
+
+ObjShape* Allocator::allocateShape(ObjShape* base, ObjString* fieldName)
+{
+	auto obj = allocateShape();
+	for (const auto& [key, index] : base->fieldIndices)
+	{
+		obj->fieldIndices.set(key, index);
+	}
+	obj->fieldIndices.set(fieldName, Value(static_cast<Int>(base->fieldCount)));
+	obj->fieldCount = base->fieldCount + 1;
 	return obj;
 }
 
 ObjInstance* Allocator::allocateInstance(ObjClass* class_)
 {
+	if (class_->emptyShape == nullptr)
+		class_->emptyShape = allocateShape();
+
 	auto obj = allocateObj(sizeof(ObjInstance), ObjType::Instance)->asInstance();
 	obj->class_ = class_;
-	new (&obj->fields) HashTable();
+	obj->shape = class_->emptyShape;
+	obj->slots = obj->inlineSlots;
+	obj->slotCapacity = ObjInstance::INLINE_SLOT_COUNT;
 	return obj;
 }
 
@@ -166,16 +240,16 @@ ObjModule* Allocator::allocateModule()
 {
 	auto obj = allocateObj(sizeof(ObjModule), ObjType::Module)->asModule();
 	obj->isLoaded = false;
-	new (&obj->globals) HashTable();
+	new (&obj->globals) Globals();
 	return obj;
 }
 
-Allocator::StringConstant Allocator::allocateStringConstant(std::string_view chars)
+ObjString* Allocator::allocateStringConstant(std::string_view chars)
 {
 	return allocateStringConstant(chars, Utf8::strlen(chars.data(), chars.size()));
 }
 
-Allocator::StringConstant Allocator::allocateStringConstant(std::string_view chars, size_t length)
+ObjString* Allocator::allocateStringConstant(std::string_view chars, size_t length)
 {
 	ObjString string;
 	string.chars = chars.data();
@@ -184,7 +258,7 @@ Allocator::StringConstant Allocator::allocateStringConstant(std::string_view cha
 	auto result = m_stringPool.find(&string);
 	if (result != m_stringPool.end())
 	{
-		return { createConstant(Value(*result)), *result };
+		return *result;
 	}
 
 	auto obj = allocateObjConstant(sizeof(ObjString) + chars.size() + 1, ObjType::String)->asString();
@@ -197,21 +271,21 @@ Allocator::StringConstant Allocator::allocateStringConstant(std::string_view cha
 	obj->length = length;
 	obj->hash = ObjString::hashString(obj->chars, obj->size);
 	m_stringPool.insert(obj);
-	return { createConstant(Value(obj)), obj };
+	return obj;
 }
 
-Allocator::FunctionConstant Allocator::allocateFunctionConstant(ObjString* name, int argCount, HashTable* globals)
+ObjFunction* Allocator::allocateFunction(ObjString* name, int argCount, Globals* globals)
 {
-	auto obj = allocateObjConstant(sizeof(ObjFunction), ObjType::Function)->asFunction();
+	auto obj = allocateObj(sizeof(ObjFunction), ObjType::Function)->asFunction();
 	obj->argCount = argCount;
 	obj->name = name;
 	obj->upvalueCount = 0;
 	obj->globals = globals;
 	new (&obj->byteCode) ByteCode();
-	return { createConstant(Value(obj)), obj };
+	return obj;
 }
 
-ObjNativeFunction* Allocator::allocateForeignFunction(ObjString* name, NativeFunction function, int argCount, HashTable* globals, void* context)
+ObjNativeFunction* Allocator::allocateForeignFunction(ObjString* name, NativeFunction function, int argCount, Globals* globals, void* context)
 {
 	auto obj = allocateObjConstant(sizeof(ObjNativeFunction), ObjType::NativeFunction)->asNativeFunction();
 	obj->type = ObjType::NativeFunction;
@@ -233,7 +307,15 @@ ObjClass* Allocator::allocateClass(ObjString* name)
 	obj->instanceSize = 0;
 	obj->nativeInstanceCount = 0;
 	new (&obj->superclass) std::optional<ObjClass&>();
+	for (auto& method : obj->specialMethods)
+		method = Value::null();
+	obj->version = 0;
+	obj->specialMethodsVersion = ObjClass::SPECIAL_METHODS_NOT_RESOLVED;
+	obj->emptyShape = nullptr;
 	new (&obj->fields) HashTable();
+	new (&obj->resolvedFields) HashTable();
+	new (&obj->subclasses) std::vector<ObjClass*>();
+	new (&obj->display) std::vector<ObjClass*>{ obj };
 	return obj;
 }
 
@@ -249,10 +331,39 @@ void Allocator::markObj(Obj* obj)
 		case ObjType::String:
 			return;
 
+		case ObjType::Int:
+			return;
+
+		case ObjType::Rope:
+		{
+			const auto rope = obj->asRope();
+			if (rope->flattened != nullptr)
+			{
+				addObj(rope->flattened);
+			}
+			else
+			{
+				addObj(rope->left);
+				addObj(rope->right);
+			}
+			return;
+		}
+
 		case ObjType::Function:
 		{
 			const auto function = obj->asFunction();
 			addObj(function->name);
+			for (const auto& constant : function->byteCode.constants)
+			{
+				addValue(constant);
+			}
+			// The caches don't keep the shapes and classes alive. If they were freed a new object could be allocated
+			// at the same address and incorrectly hit the cache so they are cleared on every collection. Functions that
+			// aren't marked are freed so only the caches of the marked ones need to be cleared.
+			for (auto& cache : function->byteCode.inlineCaches)
+			{
+				cache.clear();
+			}
 			return;
 		}
 
@@ -267,9 +378,17 @@ void Allocator::markObj(Obj* obj)
 		{
 			const auto class_ = obj->asClass();
 			addHashTable(class_->fields);
+			addHashTable(class_->resolvedFields);
 			addObj(class_->name);
+			if (class_->emptyShape != nullptr)
+				addObj(class_->emptyShape);
 			if (class_->superclass.has_value())
 				addObj(&*class_->superclass);
+			// Outdated methods might have been removed from the fields.
+			for (const auto& method : class_->specialMethods)
+			{
+				addValue(method);
+			}
 			return;
 		}
 
@@ -277,7 +396,18 @@ void Allocator::markObj(Obj* obj)
 		{
 			const auto instance = obj->asInstance();
 			addObj(instance->class_);
-			addHashTable(instance->fields);
+			if (instance->shape == nullptr)
+			{
+				addHashTable(*instance->fields);
+			}
+			else
+			{
+				addObj(instance->shape);
+				for (size_t i = 0; i < instance->shape->fieldCount; i++)
+				{
+					addValue(instance->slots[i]);
+				}
+			}
 			return;
 		}
 
@@ -321,52 +451,20 @@ void Allocator::markObj(Obj* obj)
 		case ObjType::Module:
 		{
 			const auto module = obj->asModule();
-			addHashTable(module->globals);
+			addGlobals(module->globals);
 			return;
 		}
-	}
-
-	ASSERT_NOT_REACHED();
-}
 
-size_t Allocator::createConstant(const Value& value)
-{
-	for (size_t i = 0; i < m_constants.size(); i++)
-	{
-		const auto& constant = m_constants[i];
-		if (value.type == constant.type)
+		case ObjType::Shape:
 		{
-			switch (value.type)
-			{
-				case ValueType::Int: 
-					if (value.as.intNumber == constant.as.intNumber)
-						return i;
-					break;
-				case ValueType::Float:
-					if (value.as.floatNumber == constant.as.floatNumber)
-						return i;
-					break;
-				case ValueType::Obj:
-					if ((value.as.obj->type == ObjType::String)
-						&& (constant.as.obj->type == ObjType::String)
-						/*&& (constant.as.obj->asString()->size == value.as.obj->asString()->size)
-						&& (memcmp(constant.as.obj->asString()->chars, value.as.obj->asString()->chars, value.as.obj->asString()->size) == 0))*/
-						&& (value.as.obj == constant.as.obj))
-					{
-						return i;
-					}
-					break;
-
-				case ValueType::Null:
-				case ValueType::Bool:
-					// null and bools should be created using instructions.
-					ASSERT_NOT_REACHED();
-			}
+			const auto shape = obj->asShape();
+			addHashTable(shape->fieldIndices);
+			addHashTable(shape->transitions);
+			return;
 		}
 	}
 
-	m_constants.push_back(value);
-	return m_constants.size() - 1;
+	ASSERT_NOT_REACHED();
 }
 
 void Allocator::runGc()
@@ -382,13 +480,15 @@ void Allocator::runGc()
 		function(data, *this);
 	}
 
-	for (auto& obj : m_localObjs)
-	{
-		addObj(*obj);
-	}
-	for (auto& value : m_localValues)
+	auto handlesLeft = m_handleCount;
+	for (const auto& block : m_handleBlocks)
 	{
-		addValue(*value);
+		const auto count = std::min(handlesLeft, HANDLE_BLOCK_SIZE);
+		for (size_t i = 0; i < count; i++)
+		{
+			addValue(block[i]);
+		}
+		handlesLeft -= count;
 	}
 
 	while (m_markedObjs.empty() == false)
@@ -398,15 +498,6 @@ void Allocator::runGc()
 		markObj(obj);
 	}
 
-	// Remove this
-	for (const auto o : m_constants)
-	{
-		if (o.isObj())
-		{
-			ASSERT(o.as.obj->isMarked);
-		}
-	}
-
 	// Can't use erase remove on sets.
 	for (auto it = m_stringPool.begin(); it != m_stringPool.end();)
 	{
@@ -416,13 +507,29 @@ void Allocator::runGc()
 			it = m_stringPool.erase(it);
 	}
 
+	const auto isLive = [](Obj* obj)
+	{
+		return obj->isMarked || (obj->isClass() && obj->asClass()->nativeInstanceCount > 0);
+	};
+
+	// The subclasses aren't marked, so the ones that are going to be freed have to be removed before anything is freed.
+	for (auto obj = m_head; obj != nullptr; obj = obj->next)
+	{
+		if (obj->isClass() && isLive(obj))
+		{
+			auto& subclasses = obj->asClass()->subclasses;
+			const auto isFreed = [&isLive](ObjClass* subclass) { return isLive(subclass) == false; };
+			subclasses.erase(std::remove_if(subclasses.begin(), subclasses.end(), isFreed), subclasses.end());
+		}
+	}
+
 	Obj* previous = nullptr;
 	auto obj = m_head;
 
 	// Constant's don't need to be added because this only deletes objects created normally.
 	while (obj != nullptr)
 	{
-		if (obj->isMarked || (obj->isClass() && obj->asClass()->nativeInstanceCount > 0))
+		if (isLive(obj))
 		{
 			obj->isMarked = false;
 			previous = obj;
@@ -465,6 +572,12 @@ void Allocator::addValue(Value value)
 	{
 		addObj(value.asObj());
 	}
+#ifdef VOXL_NAN_BOXING
+	else if (value.isBigInt())
+	{
+		addObj(value.bigIntObj());
+	}
+#endif
 }
 
 void Allocator::addHashTable(HashTable& hashTable)
@@ -476,6 +589,15 @@ void Allocator::addHashTable(HashTable& hashTable)
 	}
 }
 
+void Allocator::addGlobals(Globals& globals)
+{
+	for (auto& slot : globals.slots())
+	{
+		addObj(slot.name);
+		addValue(slot.value);
+	}
+}
+
 void Allocator::unregisterMarkingFunction(size_t id)
 {
 	m_markingFunctions.erase(
@@ -528,7 +650,10 @@ void Allocator::freeObj(Obj* obj)
 		case ObjType::Instance:
 		{
 			auto instance = obj->asInstance();
-			instance->fields.~HashTable();
+			if (instance->shape == nullptr)
+				delete instance->fields;
+			else if (instance->slots != instance->inlineSlots)
+				::operator delete(instance->slots);
 			free(obj, sizeof(ObjInstance));
 			break;
 		}
@@ -537,6 +662,9 @@ void Allocator::freeObj(Obj* obj)
 		{
 			auto class_ = obj->asClass();
 			class_->fields.~HashTable();
+			class_->resolvedFields.~HashTable();
+			class_->subclasses.~vector();
+			class_->display.~vector();
 			free(obj, sizeof(ObjClass));
 			break;
 		}
@@ -544,11 +672,20 @@ void Allocator::freeObj(Obj* obj)
 		case ObjType::Module:
 		{
 			auto module = obj->asModule();
-			module->globals.~HashTable();
+			module->globals.~Globals();
 			free(obj, sizeof(ObjModule));
 			break;
 		}
 
+		case ObjType::Shape:
+		{
+			auto shape = obj->asShape();
+			shape->fieldIndices.~HashTable();
+			shape->transitions.~HashTable();
+			free(obj, sizeof(ObjShape));
+			break;
+		}
+
 		case ObjType::String:
 		{
 			// TODO: Maybe remove from string pool here instead of inside runGc()?
@@ -557,6 +694,12 @@ void Allocator::freeObj(Obj* obj)
 			break;
 		}
 
+		case ObjType::Rope:
+			free(obj, sizeof(ObjRope));
+			break;
+		case ObjType::Int:
+			free(obj, sizeof(ObjInt));
+			break;
 		case ObjType::Upvalue:
 			free(obj, sizeof(ObjUpvalue));
 			break;
@@ -569,33 +712,28 @@ void Allocator::freeObj(Obj* obj)
 	}
 }
 
-const Value& Allocator::getConstant(size_t id) const
+Value& Allocator::allocateHandle(const Value& value)
 {
-	return m_constants[id];
-}
-
-void Allocator::registerLocal(Obj** obj)
-{
-	const auto isNewItem = m_localObjs.insert(obj).second == true;
-	ASSERT(isNewItem);
-}
-
-void Allocator::unregisterLocal(Obj** obj)
-{
-	const auto wasDeleted = m_localObjs.erase(obj) == 1;
-	ASSERT(wasDeleted);
+	const auto blockIndex = m_handleCount / HANDLE_BLOCK_SIZE;
+	if (blockIndex == m_handleBlocks.size())
+	{
+		m_handleBlocks.push_back(std::make_unique<Value[]>(HANDLE_BLOCK_SIZE));
+	}
+	auto& handle = m_handleBlocks[blockIndex][m_handleCount % HANDLE_BLOCK_SIZE];
+	handle = value;
+	m_handleCount++;
+	return handle;
 }
 
-void Allocator::registerLocal(Value* value)
-{
-	const auto isNewItem = m_localValues.insert(value).second == true;
-	ASSERT(isNewItem);
-}
+Allocator::HandleScope::HandleScope(Allocator& allocator)
+	: allocator(allocator)
+	, handleCount(allocator.m_handleCount)
+{}
 
-void Allocator::unregisterLocal(Value* value)
+Allocator::HandleScope::~HandleScope()
 {
-	const auto wasDeleted = m_localValues.erase(value) == 1;
-	ASSERT(wasDeleted);
+	ASSERT(allocator.m_handleCount >= handleCount);
+	allocator.m_handleCount = handleCount;
 }
 
 Allocator::MarkingFunctionHandle::~MarkingFunctionHandle()
@@ -3,6 +3,7 @@
 #include <Value.hpp>
 #include <Obj.hpp>
 #include <unordered_set>
+#include <memory>
 #include <string_view>
 
 namespace Voxl
@@ -19,6 +20,19 @@ public:
 		size_t id;
 	};
 
+	// Frees the handles allocated while it exists. A handle can't be used after its scope ends.
+	// The vm creates one for every native function call.
+	struct HandleScope
+	{
+		HandleScope(Allocator& allocator);
+		~HandleScope();
+		HandleScope(const HandleScope&) = delete;
+		HandleScope& operator=(const HandleScope&) = delete;
+
+		Allocator& allocator;
+		size_t handleCount;
+	};
+
 private:
 
 	struct MarkingFunctionEntry
@@ -46,10 +60,18 @@ public:
 
 	ObjString* allocateString(std::string_view chars);
 	ObjString* allocateString(std::string_view chars, size_t length);
-	//ObjFunction* allocateFunction(ObjString* name, int argCount, HashTable* globals);
+	// Returns a string if the result is short, otherwise a rope. The operands have to be strings or ropes and have to be
+	// reachable, because allocating may run the garbage collector.
+	Obj* allocateConcatenation(Obj* left, Obj* right);
+	// Copies the characters of the rope into an interned string the first time it is called.
+	ObjString* flattenRope(ObjRope* rope);
+#ifdef VOXL_NAN_BOXING
+	ObjInt* allocateInt(Int value);
+#endif
+	ObjFunction* allocateFunction(ObjString* name, int argCount, Globals* globals);
 	ObjClosure* allocateClosure(ObjFunction* function);
 	ObjUpvalue* allocateUpvalue(Value* localVariable);
-	ObjNativeFunction* allocateForeignFunction(ObjString* name, NativeFunction function, int argCount, HashTable* globals, void* context);
+	ObjNativeFunction* allocateForeignFunction(ObjString* name, NativeFunction function, int argCount, Globals* globals, void* context);
 	ObjClass* allocateClass(ObjString* name);
 	template<typename T>
 	ObjClass* allocateNativeClass(ObjString* name, InitFunction<T> init, FreeFunction<T> free);
@@ -63,41 +85,30 @@ public:
 	ObjClass* allocateNativeClass(
 		ObjString* name,
 		std::initializer_list<Method> methods,
-		HashTable* globals,
+		Globals* globals,
 		InitFunction<T> init = nullptr,
 		FreeFunction<T> free = nullptr,
 		void* context = nullptr);
+	ObjShape* allocateShape();
+	// Creates a shape with the fields of base and fieldName added at the end.
+	ObjShape* allocateShape(ObjShape* base, ObjString* fieldName);
 	ObjInstance* allocateInstance(ObjClass* class_);
 	ObjNativeInstance* allocateNativeInstance(ObjClass* class_);
 	ObjBoundFunction* allocateBoundFunction(Obj* callable, const Value& value);
 	ObjModule* allocateModule();
 
-	struct StringConstant
-	{
-		size_t constant;
-		ObjString* value;
-	}
-	allocateStringConstant(std::string_view chars),
-	allocateStringConstant(std::string_view chars, size_t length);
-
-	struct FunctionConstant
-	{
-		size_t index;
-		ObjFunction* value;
-	} allocateFunctionConstant(ObjString* name, int argCount, HashTable* globals);
-
-	size_t createConstant(const Value& value);
+	// Strings that are never freed. Used for names that are stored in places the GC doesn't scan.
+	ObjString* allocateStringConstant(std::string_view chars);
+	ObjString* allocateStringConstant(std::string_view chars, size_t length);
 
 	void runGc();
 
 	void addObj(Obj* obj);
 	void addValue(Value value);
 	void addHashTable(HashTable& hashTable);
-	const Value& getConstant(size_t id) const;
-	void registerLocal(Obj** obj);
-	void unregisterLocal(Obj** obj);
-	void registerLocal(Value* value);
-	void unregisterLocal(Value* value);
+	void addGlobals(Globals& globals);
+	// Returns a slot that is a GC root until the innermost HandleScope ends.
+	Value& allocateHandle(const Value& value);
 
 private:
 	void markObj(Obj* obj);
@@ -112,10 +123,14 @@ private:
 	// A stack is used instread of recursion to avoid stack overflow.
 	std::vector<Obj*> m_markedObjs;
 
-	std::vector<Value> m_constants;
+	// Objects allocated using allocateObjConstant. They are always marked and only freed in the destructor.
+	std::vector<Obj*> m_constantObjs;
 
-	std::unordered_set<Obj**> m_localObjs;
-	std::unordered_set<Value*> m_localValues;
+	// The handles are allocated and freed in stack order. They are stored in blocks so the slots don't move when
+	// more handles are allocated.
+	static constexpr size_t HANDLE_BLOCK_SIZE = 1024;
+	std::vector<std::unique_ptr<Value[]>> m_handleBlocks;
+	size_t m_handleCount;
 
 	size_t m_bytesAllocated;
 	size_t m_bytesAllocatedAfterWhichTheGcRuns;
@@ -171,7 +186,15 @@ Voxl::ObjClass* Voxl::Allocator::allocateNativeClass(ObjString* name, InitFuncti
 	obj->instanceSize = sizeof(T);
 	obj->nativeInstanceCount = 0;
 	new (&obj->superclass) std::optional<ObjClass&>();
+	for (auto& method : obj->specialMethods)
+		method = Value::null();
+	obj->version = 0;
+	obj->specialMethodsVersion = ObjClass::SPECIAL_METHODS_NOT_RESOLVED;
+	obj->emptyShape = nullptr;
 	new (&obj->fields) HashTable();
+	new (&obj->resolvedFields) HashTable();
+	new (&obj->subclasses) std::vector<ObjClass*>();
+	new (&obj->display) std::vector<ObjClass*>{ obj };
 	return obj;
 }
 
@@ -179,7 +202,7 @@ template<typename T>
 Voxl::ObjClass* Voxl::Allocator::allocateNativeClass(
 	ObjString* name,
 	std::initializer_list<Method> methods, 
-	HashTable* globals,
+	Globals* globals,
 	InitFunction<T> init,
 	FreeFunction<T> free,
 	void* context)
@@ -193,9 +216,9 @@ Voxl::ObjClass* Voxl::Allocator::allocateNativeClass(
 
 	for (const auto& method : methods)
 	{
-		const auto methodName = allocateStringConstant(method.name).value;
+		const auto methodName = allocateStringConstant(method.name);
 		const auto methodDisplayedName =
-			allocateStringConstant((std::string(name->chars, name->size) + "." + std::string(method.name))).value;
+			allocateStringConstant((std::string(name->chars, name->size) + "." + std::string(method.name)));
 		const auto methodFunction = allocateForeignFunction(
 			methodDisplayedName,
 			method.function,
@@ -205,6 +228,8 @@ Voxl::ObjClass* Voxl::Allocator::allocateNativeClass(
 
 		bool inserted = class_->fields.insertIfNotSet(methodName, Value(methodFunction));
 		ASSERT(inserted);
+		// The class was just created so it doesn't have a superclass or subclasses.
+		class_->resolvedFields.set(methodName, Value(methodFunction));
 	}
 
 	return class_;
@@ -195,6 +195,18 @@ LoopStmt::LoopStmt(
 	, block(std::move(block))
 {}
 
+ForStmt::ForStmt(
+	std::string_view itemName,
+	std::unique_ptr<Expr> iterable,
+	std::vector<std::unique_ptr<Stmt>> block,
+	size_t start,
+	size_t end)
+	: Stmt(start, end, StmtType::For)
+	, itemName(itemName)
+	, iterable(std::move(iterable))
+	, block(std::move(block))
+{}
+
 BreakStmt::BreakStmt(size_t start, size_t end)
 	: Stmt(start, end, StmtType::Break)
 {}
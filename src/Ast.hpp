@@ -54,6 +54,7 @@ enum class StmtType
 	Ret,
 	If,
 	Loop,
+	For,
 	Break,
 	Class,
 	Impl,
@@ -308,6 +309,20 @@ struct LoopStmt final : public Stmt
 	std::vector<std::unique_ptr<Stmt>> block;
 };
 
+struct ForStmt final : public Stmt
+{
+	ForStmt(
+		std::string_view itemName,
+		std::unique_ptr<Expr> iterable,
+		std::vector<std::unique_ptr<Stmt>> block,
+		size_t start,
+		size_t end);
+
+	std::string_view itemName;
+	std::unique_ptr<Expr> iterable;
+	std::vector<std::unique_ptr<Stmt>> block;
+};
+
 struct BreakStmt final : public Stmt
 {
 	BreakStmt(size_t start, size_t end);
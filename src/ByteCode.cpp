@@ -1,9 +1,468 @@
 #include <ByteCode.hpp>
+#include <Asserts.hpp>
+
+#include <algorithm>
+#include <utility>
 
 using namespace Voxl;
 
 void ByteCode::append(const ByteCode& src)
 {
+	const auto srcOffset = code.size();
 	code.insert(code.end(), src.code.begin(), src.code.end());
 	lineNumberAtOffset.insert(lineNumberAtOffset.end(), src.lineNumberAtOffset.begin(), src.lineNumberAtOffset.end());
+	for (auto handler : src.exceptionHandlers)
+	{
+		handler.begin += srcOffset;
+		handler.end += srcOffset;
+		handler.handlerOffset += srcOffset;
+		exceptionHandlers.push_back(handler);
+	}
+}
+
+const ByteCode::ExceptionHandler* ByteCode::findExceptionHandler(size_t offset) const
+{
+	for (const auto& handler : exceptionHandlers)
+	{
+		if ((offset >= handler.begin) && (offset < handler.end))
+			return &handler;
+	}
+	return nullptr;
+}
+
+namespace
+{
+	enum class OperandLayout
+	{
+		None,
+		Uint32,
+		TwoUint32,
+		ThreeUint32,
+		ForwardJump,
+		BackwardJump,
+		Uint8,
+		Closure,
+	};
+}
+
+static OperandLayout operandLayout(Op op)
+{
+	switch (op)
+	{
+	case Op::GetConstant:
+	case Op::GetLocal:
+	case Op::SetLocal:
+	case Op::CreateGlobal:
+	case Op::GetGlobal:
+	case Op::SetGlobal:
+	case Op::GetUpvalue:
+	case Op::SetUpvalue:
+	case Op::Call:
+	case Op::TailCall:
+	case Op::GetField:
+	case Op::SetField:
+	case Op::ConcatN:
+		return OperandLayout::Uint32;
+
+	case Op::AddLocals:
+	case Op::LessLocalConstantJumpIfFalse:
+	case Op::LessEqualLocalConstantJumpIfFalse:
+	case Op::MoreLocalConstantJumpIfFalse:
+	case Op::MoreEqualLocalConstantJumpIfFalse:
+	case Op::AddLocalConstant:
+		return OperandLayout::TwoUint32;
+
+	case Op::Invoke:
+		return OperandLayout::ThreeUint32;
+
+	case Op::Jump:
+	case Op::JumpIfTrue:
+	case Op::JumpIfFalse:
+	case Op::JumpIfFalseAndPop:
+	case Op::ForIter:
+	case Op::ForRangeBegin:
+	case Op::ForRange:
+		return OperandLayout::ForwardJump;
+
+	case Op::JumpBack:
+		return OperandLayout::BackwardJump;
+
+	case Op::CloseUpvalue:
+		return OperandLayout::Uint8;
+
+	case Op::Closure:
+		return OperandLayout::Closure;
+
+	default:
+		return OperandLayout::None;
+	}
+}
+
+static uint32_t readUint32At(const std::vector<uint8_t>& code, size_t offset)
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < 4; i++)
+	{
+		value <<= 8;
+		value |= code[offset + i];
+	}
+	return value;
 }
+
+static size_t instructionSize(const std::vector<uint8_t>& code, size_t offset)
+{
+	switch (operandLayout(static_cast<Op>(code[offset])))
+	{
+	case OperandLayout::None: return 1;
+	case OperandLayout::Uint32:
+	case OperandLayout::ForwardJump:
+	case OperandLayout::BackwardJump:
+		return 5;
+	case OperandLayout::TwoUint32: return 9;
+	case OperandLayout::ThreeUint32: return 13;
+	case OperandLayout::Uint8: return 2;
+	case OperandLayout::Closure: return 2 + static_cast<size_t>(code[offset + 1]) * 2;
+	}
+	ASSERT_NOT_REACHED();
+	return 1;
+}
+
+// Returns the change of the stack size when the instruction doesn't jump.
+static int stackEffect(const std::vector<uint8_t>& code, size_t offset)
+{
+	switch (static_cast<Op>(code[offset]))
+	{
+	case Op::Add:
+	case Op::Subtract:
+	case Op::Multiply:
+	case Op::Divide:
+	case Op::Modulo:
+	case Op::Concat:
+	case Op::Less:
+	case Op::LessEqual:
+	case Op::More:
+	case Op::MoreEqual:
+	case Op::Equals:
+	case Op::AddInt:
+	case Op::AddFloat:
+	case Op::SubtractInt:
+	case Op::SubtractFloat:
+	case Op::MultiplyInt:
+	case Op::MultiplyFloat:
+	case Op::LessInt:
+	case Op::LessFloat:
+	case Op::LessEqualInt:
+	case Op::LessEqualFloat:
+	case Op::MoreInt:
+	case Op::MoreFloat:
+	case Op::MoreEqualInt:
+	case Op::MoreEqualFloat:
+	case Op::CreateGlobal:
+	case Op::GetField:
+	case Op::GetIndex:
+	case Op::ListPush:
+	case Op::JumpIfFalseAndPop:
+	case Op::PopStack:
+	case Op::ModuleImportAllToGlobalNamespace:
+	case Op::Inherit:
+		return -1;
+
+	case Op::SetField:
+	case Op::StoreMethod:
+	case Op::SetIndex:
+	case Op::DictSet:
+		return -2;
+
+	case Op::GetConstant:
+	case Op::GetLocal:
+	case Op::GetGlobal:
+	case Op::GetUpvalue:
+	case Op::LoadNull:
+	case Op::LoadTrue:
+	case Op::LoadFalse:
+	case Op::CreateList:
+	case Op::CreateDict:
+	case Op::CloneTop:
+	case Op::AddLocals:
+	case Op::ForIter:
+	case Op::ForRange:
+	// The superinstructions followed by other ops are treated as if they executed the first ops of the sequence.
+	case Op::LessLocalConstantJumpIfFalse:
+	case Op::LessEqualLocalConstantJumpIfFalse:
+	case Op::MoreLocalConstantJumpIfFalse:
+	case Op::MoreEqualLocalConstantJumpIfFalse:
+	case Op::AddLocalConstant:
+		return 1;
+
+	case Op::CloneTopTwo:
+		return 2;
+
+	case Op::Call:
+	case Op::TailCall:
+		return -static_cast<int>(readUint32At(code, offset + 1));
+
+	case Op::Invoke:
+		return -static_cast<int>(readUint32At(code, offset + 1 + 8));
+
+	case Op::ConcatN:
+		return 1 - static_cast<int>(readUint32At(code, offset + 1));
+
+	default:
+		return 0;
+	}
+}
+
+// Returns the change of the stack size when the instruction jumps.
+static int jumpStackEffect(Op op)
+{
+	switch (op)
+	{
+	case Op::JumpIfFalseAndPop:
+	case Op::ForRangeBegin:
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+void ByteCode::computeMaxStackSize(size_t argCount)
+{
+	// The stack size at the start of each reachable instruction. The compiler emits code in which every path to an
+	// instruction has the same stack size, so each instruction only has to be visited once.
+	std::vector<int> stackSizeAtOffset(code.size(), -1);
+	std::vector<std::pair<size_t, int>> worklist;
+	const auto visit = [&](size_t offset, int stackSize)
+	{
+		if ((offset < code.size()) && (stackSizeAtOffset[offset] == -1))
+		{
+			stackSizeAtOffset[offset] = stackSize;
+			worklist.emplace_back(offset, stackSize);
+		}
+	};
+
+	visit(0, static_cast<int>(argCount));
+	// The vm enters a handler with the stack truncated to the size at the start of the try block and the exception
+	// pushed.
+	for (const auto& handler : exceptionHandlers)
+	{
+		visit(handler.handlerOffset, static_cast<int>(handler.stackSize) + 1);
+	}
+
+	int maxSize = static_cast<int>(argCount);
+	while (worklist.empty() == false)
+	{
+		const auto [offset, stackSize] = worklist.back();
+		worklist.pop_back();
+		maxSize = std::max(maxSize, stackSize);
+
+		const auto op = static_cast<Op>(code[offset]);
+		const auto next = offset + instructionSize(code, offset);
+		switch (operandLayout(op))
+		{
+		case OperandLayout::ForwardJump:
+			visit(next + readUint32At(code, offset + 1), stackSize + jumpStackEffect(op));
+			break;
+		case OperandLayout::BackwardJump:
+			visit(next - readUint32At(code, offset + 1), stackSize);
+			break;
+		default:
+			break;
+		}
+
+		if ((op == Op::Jump) || (op == Op::JumpBack) || (op == Op::Return) || (op == Op::Throw))
+			continue;
+		const auto nextStackSize = stackSize + stackEffect(code, offset);
+		maxSize = std::max(maxSize, nextStackSize);
+		visit(next, nextStackSize);
+	}
+	maxStackSize = static_cast<size_t>(maxSize);
+}
+
+void ByteCode::assignInlineCaches()
+{
+	// The compiler can't assign the indices, because the finally blocks are compiled seperately and then copied.
+	for (size_t offset = 0; offset < code.size(); offset += instructionSize(code, offset))
+	{
+		const auto op = static_cast<Op>(code[offset]);
+		if ((op != Op::GetField) && (op != Op::SetField) && (op != Op::Invoke))
+			continue;
+
+		const auto index = static_cast<uint32_t>(inlineCaches.size());
+		inlineCaches.emplace_back();
+		for (size_t i = 0; i < 4; i++)
+		{
+			code[offset + 1 + i] = static_cast<uint8_t>(index >> ((3 - i) * 8));
+		}
+	}
+}
+
+#ifdef VOXL_PREDECODED_BYTECODE
+
+const CodeUnit* ByteCode::executableCode()
+{
+	if (isPrepared == false)
+	{
+		assignInlineCaches();
+		predecode();
+		isPrepared = true;
+	}
+	return predecoded.data();
+}
+
+size_t ByteCode::offsetOf(const CodeUnit* instruction) const
+{
+	const auto index = static_cast<size_t>(instruction - predecoded.data());
+	// The instruction pointer may point to the end of the code after the last instruction is read.
+	if (index >= offsetAtPredecodedIndex.size())
+		return code.size();
+	return offsetAtPredecodedIndex[index];
+}
+
+const CodeUnit* ByteCode::codeAtOffset(size_t offset) const
+{
+	// The operands have the offset of their instruction so the first index with the offset is the op.
+	const auto index = std::lower_bound(offsetAtPredecodedIndex.begin(), offsetAtPredecodedIndex.end(), offset)
+		- offsetAtPredecodedIndex.begin();
+	return predecoded.data() + index;
+}
+
+void ByteCode::predecode()
+{
+	// The first pass finds the index of each instruction in the predecoded code so jumps can be translated.
+	// The entry after the last instruction is needed for jumps to the end of the code.
+	std::vector<uint32_t> predecodedIndexAtOffset(code.size() + 1, 0);
+	uint32_t index = 0;
+	for (size_t offset = 0; offset < code.size();)
+	{
+		predecodedIndexAtOffset[offset] = index;
+		switch (operandLayout(static_cast<Op>(code[offset])))
+		{
+		case OperandLayout::None:
+			offset += 1;
+			index += 1;
+			break;
+		case OperandLayout::Uint32:
+		case OperandLayout::ForwardJump:
+		case OperandLayout::BackwardJump:
+			offset += 5;
+			index += 2;
+			break;
+		case OperandLayout::TwoUint32:
+			offset += 9;
+			index += 3;
+			break;
+		case OperandLayout::ThreeUint32:
+			offset += 13;
+			index += 4;
+			break;
+		case OperandLayout::Uint8:
+			offset += 2;
+			index += 2;
+			break;
+		case OperandLayout::Closure:
+		{
+			const size_t upvalueCount = code[offset + 1];
+			offset += 2 + upvalueCount * 2;
+			index += 2 + static_cast<uint32_t>(upvalueCount) * 2;
+			break;
+		}
+		}
+	}
+	predecodedIndexAtOffset[code.size()] = index;
+
+	predecoded.reserve(index);
+	offsetAtPredecodedIndex.reserve(index);
+	const auto emit = [this](uint32_t value, size_t offset)
+	{
+		predecoded.push_back(value);
+		offsetAtPredecodedIndex.push_back(static_cast<uint32_t>(offset));
+	};
+
+	for (size_t offset = 0; offset < code.size();)
+	{
+		const auto instructionOffset = offset;
+		emit(code[offset], instructionOffset);
+		switch (operandLayout(static_cast<Op>(code[offset])))
+		{
+		case OperandLayout::None:
+			offset += 1;
+			break;
+
+		case OperandLayout::Uint32:
+			emit(readUint32At(code, offset + 1), instructionOffset);
+			offset += 5;
+			break;
+
+		case OperandLayout::TwoUint32:
+			for (size_t i = 0; i < 2; i++)
+			{
+				emit(readUint32At(code, offset + 1 + i * 4), instructionOffset);
+			}
+			offset += 9;
+			break;
+
+		case OperandLayout::ThreeUint32:
+			for (size_t i = 0; i < 3; i++)
+			{
+				emit(readUint32At(code, offset + 1 + i * 4), instructionOffset);
+			}
+			offset += 13;
+			break;
+
+		case OperandLayout::ForwardJump:
+		case OperandLayout::BackwardJump:
+		{
+			const auto isForward = operandLayout(static_cast<Op>(code[offset])) == OperandLayout::ForwardJump;
+			const auto jump = readUint32At(code, offset + 1);
+			offset += 5;
+			const auto target = isForward ? offset + jump : offset - jump;
+			ASSERT(target <= code.size());
+			const auto from = predecodedIndexAtOffset[offset];
+			const auto to = predecodedIndexAtOffset[target];
+			emit(isForward ? to - from : from - to, instructionOffset);
+			break;
+		}
+
+		case OperandLayout::Uint8:
+			emit(code[offset + 1], instructionOffset);
+			offset += 2;
+			break;
+
+		case OperandLayout::Closure:
+		{
+			const size_t upvalueCount = code[offset + 1];
+			emit(static_cast<uint32_t>(upvalueCount), instructionOffset);
+			for (size_t i = 0; i < upvalueCount * 2; i++)
+			{
+				emit(code[offset + 2 + i], instructionOffset);
+			}
+			offset += 2 + upvalueCount * 2;
+			break;
+		}
+		}
+	}
+}
+
+#else
+
+const CodeUnit* ByteCode::executableCode()
+{
+	if (isPrepared == false)
+	{
+		assignInlineCaches();
+		isPrepared = true;
+	}
+	return code.data();
+}
+
+size_t ByteCode::offsetOf(const CodeUnit* instruction) const
+{
+	return static_cast<size_t>(instruction - code.data());
+}
+
+const CodeUnit* ByteCode::codeAtOffset(size_t offset) const
+{
+	return code.data() + offset;
+}
+
+#endif
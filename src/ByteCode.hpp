@@ -1,6 +1,8 @@
 #pragma once
 
 #include <Op.hpp>
+#include <Vm/InlineCache.hpp>
+#include <Value.hpp>
 
 #include <stdint.h>
 #include <vector>
@@ -8,17 +10,68 @@
 namespace Voxl
 {
 
-	class Value;
+#ifdef VOXL_PREDECODED_BYTECODE
+	// Every op and every operand is stored in a separate aligned word so the vm doesn't have to reassemble operands.
+	using CodeUnit = uint32_t;
+#else
+	using CodeUnit = uint8_t;
+#endif
 
 	struct ByteCode
 	{
+		// Exceptions thrown by instructions at offsets in [begin, end) are caught by the handler at handlerOffset.
+		struct ExceptionHandler
+		{
+			size_t begin;
+			size_t end;
+			size_t handlerOffset;
+			// Number of values of the frame on the stack at the start of the try block.
+			size_t stackSize;
+		};
+
 		void append(const ByteCode& src);
+		// Returns the innermost handler of the instruction at offset or nullptr if there isn't one.
+		const ExceptionHandler* findExceptionHandler(size_t offset) const;
+
+		// Returns the code the vm should execute. On the first call it assigns inline caches to the instructions that use
+		// them and if predecoding is enabled translates the code.
+		const CodeUnit* executableCode();
+		// Converts a pointer into the executable code into an offset into code.
+		size_t offsetOf(const CodeUnit* instruction) const;
+		// Converts an offset of an instruction into a pointer into the executable code.
+		const CodeUnit* codeAtOffset(size_t offset) const;
+		// Sets maxStackSize. Has to be called after the code of the function is complete.
+		void computeMaxStackSize(size_t argCount);
 
 		std::vector<uint8_t> code;
+		// The constants used by the function. The code of finally blocks is compiled into a separate ByteCode and
+		// appended, so it uses the constants of the function it is appended to.
+		std::vector<Value> constants;
 		// Could use RLE compression if the size is an issuse though I don't see why would it be.
 		// Finding the line of an opcode would just require searching through the array.
 		// Using the line numbers in disassembly would be just done linearly.
 		std::vector<size_t> lineNumberAtOffset;
+		// Inner handlers come before the outer ones so the first handler containing an offset is the innermost one.
+		std::vector<ExceptionHandler> exceptionHandlers;
+
+		// The maximum number of values of the frame on the stack including the arguments. Doesn't include the values
+		// the vm pushes temporarily while executing a single instruction.
+		size_t maxStackSize = 0;
+
+		std::vector<InlineCache> inlineCaches;
+		bool isPrepared = false;
+
+#ifdef VOXL_PREDECODED_BYTECODE
+		// Jump operands are converted to be relative to the predecoded code.
+		std::vector<uint32_t> predecoded;
+		std::vector<uint32_t> offsetAtPredecodedIndex;
+#endif
+
+	private:
+		void assignInlineCaches();
+#ifdef VOXL_PREDECODED_BYTECODE
+		void predecode();
+#endif
 	};
 
-}
\ No newline at end of file
+}
@@ -23,6 +23,7 @@ Compiler::Compiler(Allocator& allocator)
 	, m_sourceInfo(nullptr)
 	, m_rootMarkingFunctionHandle(allocator.registerMarkingFunction(this, Compiler::mark))
 	, m_module(nullptr)
+	, m_program(nullptr)
 {}
 
 Compiler::Result Compiler::compile(const StmtList& ast, const SourceInfo& sourceInfo, ErrorReporter& errorReporter, std::optional<ObjModule*> module)
@@ -32,10 +33,11 @@ Compiler::Result Compiler::compile(const StmtList& ast, const SourceInfo& source
 	m_sourceInfo = &sourceInfo;
 
 	m_module = module.has_value() ? *module : m_allocator.allocateModule();
-	const auto scriptName = m_allocator.allocateStringConstant("script").value;
-	auto scriptFunction = m_allocator.allocateFunctionConstant(scriptName, 0, &m_module->globals).value;
+	const auto scriptName = m_allocator.allocateStringConstant("script");
+	auto scriptFunction = m_allocator.allocateFunction(scriptName, 0, &m_module->globals);
+	m_program = scriptFunction;
 	m_functionByteCodeStack.push_back(&scriptFunction->byteCode);
-	m_functions.push_back(Function{});
+	m_functions.push_back(Function{ scriptFunction });
 
 	for (const auto& stmt : ast)
 	{
@@ -52,6 +54,7 @@ Compiler::Result Compiler::compile(const StmtList& ast, const SourceInfo& source
 	emitOp(Op::LoadNull);
 	emitOp(Op::Return);
 	m_lineNumberStack.pop_back();
+	scriptFunction->byteCode.computeMaxStackSize(0);
 
 	m_functionByteCodeStack.pop_back();
 	m_functions.pop_back();
@@ -60,7 +63,7 @@ Compiler::Result Compiler::compile(const StmtList& ast, const SourceInfo& source
 	if (m_hadError == false)
 	{
 		std::cout << "----<script>\n";
-		disassembleByteCode(scriptFunction->byteCode, m_allocator);
+		disassembleByteCode(scriptFunction->byteCode);
 	}
 #endif
 
@@ -74,7 +77,7 @@ Compiler::Status Compiler::compileFunction(
 	const SourceLocation& location)
 {
 	m_functionByteCodeStack.push_back(&function->byteCode);
-	m_functions.push_back(Function{});
+	m_functions.push_back(Function{ function });
 
 	beginScope();
 	currentScope().functionDepth++;
@@ -97,10 +100,11 @@ Compiler::Status Compiler::compileFunction(
 	TRY(compile(stmts));
 	emitOp(Op::LoadNull);
 	emitOp(Op::Return);
+	function->byteCode.computeMaxStackSize(arguments.size());
 
 #ifdef VOXL_DEBUG_PRINT_COMPILED_FUNCTIONS
 	std::cout << "----" << function->name->chars << '\n';
-	disassembleByteCode(function->byteCode, m_allocator);
+	disassembleByteCode(function->byteCode);
 #endif
 
 	endScope();
@@ -144,6 +148,7 @@ Compiler::Status Compiler::compile(const std::unique_ptr<Stmt>& stmt)
 		CASE_STMT_TYPE(Ret, retStmt)
 		CASE_STMT_TYPE(If, ifStmt)
 		CASE_STMT_TYPE(Loop, loopStmt)
+		CASE_STMT_TYPE(For, forStmt)
 		CASE_STMT_TYPE(Break, breakStmt)
 		CASE_STMT_TYPE(Class, classStmt)
 		CASE_STMT_TYPE(Impl, implStmt)
@@ -170,9 +175,7 @@ Compiler::Status Compiler::compile(const std::vector<std::unique_ptr<Stmt>>& stm
 
 Compiler::Status Compiler::exprStmt(const ExprStmt& stmt)
 {
-	TRY(compile(stmt.expr));
-	emitOp(Op::PopStack);
-	return Status::Ok;
+	return compileDiscarded(stmt.expr);
 }
 
 Compiler::Status Compiler::variableDeclarationStmt(const VariableDeclarationStmt& stmt)
@@ -207,9 +210,8 @@ Compiler::Status Compiler::blockStmt(const BlockStmt& stmt)
 
 Compiler::Status Compiler::fnStmt(const FnStmt& stmt)
 {
-	const auto [nameConstant, name] = m_allocator.allocateStringConstant(stmt.name);
 	const auto [functionConstant, function] =
-		m_allocator.allocateFunctionConstant(name, static_cast<int>(stmt.arguments.size()), &m_module->globals);
+		createFunctionConstant(stmt.name, static_cast<int>(stmt.arguments.size()));
 	TRY(loadConstant(functionConstant));
 	TRY(createVariable(stmt.name, stmt.location()));
 	return compileFunction(function, stmt.arguments, stmt.stmts, stmt.location());
@@ -217,16 +219,21 @@ Compiler::Status Compiler::fnStmt(const FnStmt& stmt)
 
 Compiler::Status Compiler::retStmt(const RetStmt& stmt)
 {
+	// Exception handlers are found using the frame of the function, so the frame can't be reused inside try.
+	bool isInsideTry = false;
 	// Not using backwards iterators because cleanUpBeforeJumpingOutOfScope can change m_scopes invalidating iterators.
-	for (auto i = m_scopes.size() - 1; (i != 0) && (m_scopes[i].functionDepth == currentScope().functionDepth);)
+	auto i = m_scopes.size() - 1;
+	for (; (i != 0) && (m_scopes[i].functionDepth == currentScope().functionDepth);)
 	{
-		const auto& scope = m_scopes[i];
+		auto& scope = m_scopes[i];
 		if (scope.type == ScopeType::Finally)
 		{
 			return errorAt(stmt.location(), "ret not allowed inside finally block");
 		}
 		else
 		{
+			if (scope.type != ScopeType::Default)
+				isInsideTry = true;
 			TRY(cleanUpBeforeJumpingOutOfScope(scope, false));
 		}
 
@@ -238,17 +245,23 @@ Compiler::Status Compiler::retStmt(const RetStmt& stmt)
 	{
 		emitOp(Op::LoadNull);
 	}
+	else if ((isInsideTry == false) && ((*stmt.returnValue)->type == ExprType::Call)
+		&& (static_cast<const CallExpr&>(**stmt.returnValue).calle->type != ExprType::GetField))
+	{
+		TRY(compileCall(static_cast<const CallExpr&>(**stmt.returnValue), Op::TailCall));
+	}
 	else
 	{
 		TRY(compile(*stmt.returnValue));
 	}
 	emitOp(Op::Return);
+	reopenProtectedRanges(i + 1);
 	return Status::Ok;
 }
 
 Compiler::Status Compiler::ifStmt(const IfStmt& stmt)
 {
-	TRY(compile(stmt.condition));
+	TRY(compileCondition(stmt.condition));
 
 	auto jumpToElse = emitJump(Op::JumpIfFalseAndPop);
 
@@ -288,7 +301,7 @@ Compiler::Status Compiler::loopStmt(const LoopStmt& stmt)
 	size_t jumpToEnd = 0; // Won't be used if there is no condition.
 	if (stmt.condition.has_value())
 	{
-		TRY(compile(*stmt.condition));
+		TRY(compileCondition(*stmt.condition));
 		jumpToEnd = emitJump(Op::JumpIfFalseAndPop);
 	}
 
@@ -296,8 +309,7 @@ Compiler::Status Compiler::loopStmt(const LoopStmt& stmt)
 	TRY(compile(stmt.block));
 	if (stmt.iterationExpr.has_value())
 	{
-		TRY(compile(*stmt.iterationExpr));
-		emitOp(Op::PopStack);
+		TRY(compileDiscarded(*stmt.iterationExpr));
 	}
 	endScope();
 
@@ -321,6 +333,103 @@ Compiler::Status Compiler::loopStmt(const LoopStmt& stmt)
 	return Status::Ok;
 }
 
+Compiler::Status Compiler::forStmt(const ForStmt& stmt)
+{
+	/*
+	Code generated
+	{
+		.iterator : GetIter <iterable>;
+		.index : 0;
+		loop {
+			<item> : ForIter or jump to end;
+			<stmts>
+		}
+		handler of ForIter:
+		<catch StopIteration and jump to end or rethrow>
+	}
+	If the iterable is a call to Range with 2 arguments ForRangeBegin is emitted before the call. When Range is the
+	builtin it skips the call and GetIter. ForIter is replaced with ForRange.
+	*/
+
+	beginScope();
+	const auto rangeCall = countedLoopRange(*stmt.iterable);
+	if (rangeCall != nullptr)
+	{
+		TRY(compile(rangeCall->calle));
+		for (const auto& argument : rangeCall->arguments)
+		{
+			TRY(compile(argument));
+		}
+		const auto jumpPastCall = emitJump(Op::ForRangeBegin);
+		emitOp(Op::Call);
+		emitUint32(static_cast<uint32_t>(rangeCall->arguments.size()));
+		emitOp(Op::GetIter);
+		TRY(loadConstant(createConstant(Value::intNum(0))));
+		setJumpToHere(jumpPastCall);
+	}
+	else
+	{
+		TRY(compile(stmt.iterable));
+		emitOp(Op::GetIter);
+		TRY(loadConstant(createConstant(Value::intNum(0))));
+	}
+	TRY(createSpecialVariable(".iterator", stmt.location()));
+	TRY(createSpecialVariable(".index", stmt.location()));
+
+	const auto beginning = currentLocation();
+	m_loops.push_back(Loop{ beginning, m_scopes.size() });
+	const auto jumpToEnd = emitJump((rangeCall != nullptr) ? Op::ForRange : Op::ForIter);
+	std::vector<ByteCode::ExceptionHandler> forIterRange{ { beginning, currentLocation(), 0, localsCount() } };
+
+	beginScope();
+	TRY(createVariable(stmt.itemName, stmt.location()));
+	beginScope();
+	TRY(compile(stmt.block));
+	endScope();
+	endScope();
+
+	emitJump(Op::JumpBack, beginning);
+
+	// Only the ForIter is protected so exceptions thrown inside the block aren't caught.
+	setExceptionHandlerToHere(forIterRange);
+	TRY(loadVariable("StopIteration"));
+	emitOp(Op::MatchClass);
+	const auto jumpToRethrow = emitJump(Op::JumpIfFalseAndPop);
+	emitOp(Op::PopStack); // Pop the caught value.
+	const auto jumpToEndFromHandler = emitJump(Op::Jump);
+	setJumpToHere(jumpToRethrow);
+	emitOp(Op::Throw);
+
+	setJumpToHere(jumpToEnd);
+	setJumpToHere(jumpToEndFromHandler);
+	const auto& loop = m_loops.back();
+	for (const auto& location : loop.breakJumpLocations)
+	{
+		setJumpToHere(location);
+	}
+
+	endScope();
+
+	m_loops.pop_back();
+
+	return Status::Ok;
+}
+
+const CallExpr* Compiler::countedLoopRange(const Expr& iterable)
+{
+	if (iterable.type != ExprType::Call)
+		return nullptr;
+
+	const auto& call = static_cast<const CallExpr&>(iterable);
+	if ((call.calle->type != ExprType::Identifier)
+		|| (static_cast<const IdentifierExpr&>(*call.calle).identifier != "Range")
+		|| (call.arguments.size() != 2))
+	{
+		return nullptr;
+	}
+	return &call;
+}
+
 Compiler::Status Compiler::breakStmt(const BreakStmt& stmt)
 {
 	if (m_loops.empty() || (m_scopes[m_loops.back().scopeDepth].functionDepth != currentFunctionDepth()))
@@ -332,7 +441,7 @@ Compiler::Status Compiler::breakStmt(const BreakStmt& stmt)
 	// Not using iterators because cleanUpBeforeJumpingOutOfScope can change m_scopes invalidating iterators.
 	for (auto i = currentLoop.scopeDepth; i < m_scopes.size(); i++)
 	{
-		const auto scope = m_scopes[i];
+		auto& scope = m_scopes[i];
 
 		if ((scope.functionDepth == currentScope().functionDepth) && (scope.type == ScopeType::Finally))
 			return errorAt(stmt.location(), "break not allowed inside finally block");
@@ -341,6 +450,7 @@ Compiler::Status Compiler::breakStmt(const BreakStmt& stmt)
 	}
 	const auto jump = emitJump(Op::Jump);
 	currentLoop.breakJumpLocations.push_back(jump);
+	reopenProtectedRanges(currentLoop.scopeDepth);
 	return Status::Ok;
 }
 
@@ -348,7 +458,7 @@ Compiler::Status Compiler::tryStmt(const TryStmt& stmt)
 {
 	/*
 	Code generated
-	try { There is no scope created for the first try just TryBegin emmited.
+	try { Both try scopes start at the same offset. The handlers are stored in the exception table of the function.
 		try {
 			<actual try>
 		} catch {
@@ -381,18 +491,14 @@ Compiler::Status Compiler::tryStmt(const TryStmt& stmt)
 	// TODO Could just store one copy of this or maybe just store a std::optional<Bytecode&>.
 	ByteCode emptyByteCode;
 	// TODO: could remove this if there is no finally.
-	const auto jumpToFinallyWithRethrow = emitJump(Op::TryBegin);
-	beginScope(ScopeType::Try);
-	currentScope().try_.finallyBlockByteCode = &emptyByteCode;
+	beginTryScope(&emptyByteCode);
 
-	const auto jumpToCatchBlocks = emitJump(Op::TryBegin);
-	beginScope(ScopeType::Try);
-	currentScope().try_.finallyBlockByteCode = &finallyBlockByteCode;
+	beginTryScope(&finallyBlockByteCode);
 	TRY(compile(stmt.tryBlock));
-	endScope();
+	auto catchBlocksProtectedRanges = endTryScope();
 	const auto jumpToEndOfCatchBlocks = emitJump(Op::Jump);
 
-	setJumpToHere(jumpToCatchBlocks);
+	setExceptionHandlerToHere(catchBlocksProtectedRanges);
 	std::vector<size_t> jumpsToCatchEpilogue;
 	for (const auto& catchBlock : stmt.catchBlocks)
 	{
@@ -429,7 +535,7 @@ Compiler::Status Compiler::tryStmt(const TryStmt& stmt)
 
 	setJumpToHere(jumpToEndOfCatchBlocks);
 
-	endScope(); // jumpToFinallyWithRethrow end
+	auto finallyWithRethrowProtectedRanges = endTryScope();
 
 
 	if (stmt.finallyBlock.has_value())
@@ -437,7 +543,7 @@ Compiler::Status Compiler::tryStmt(const TryStmt& stmt)
 		currentByteCode().append(finallyBlockByteCode);
 		const auto jumpPastFinallyRethrow = emitJump(Op::Jump);
 
-		setJumpToHere(jumpToFinallyWithRethrow);
+		setExceptionHandlerToHere(finallyWithRethrowProtectedRanges);
 		beginScope();
 		// Register caught value to the compiler so it is popped of when needed.
 		const auto caughtValueName = "";
@@ -454,7 +560,7 @@ Compiler::Status Compiler::tryStmt(const TryStmt& stmt)
 	else
 	{
 		const auto jumpPastFinallyRethrow = emitJump(Op::Jump);
-		setJumpToHere(jumpToFinallyWithRethrow);
+		setExceptionHandlerToHere(finallyWithRethrowProtectedRanges);
 		// This code handles the case if there is a throw inside catch. 
 		// TODO: Comment this better and maybe rename some things.
 		emitOp(Op::Throw);
@@ -478,14 +584,12 @@ Compiler::Status Compiler::compileMethods(std::string_view className, const std:
 	{
 		auto arguments = method->arguments;
 		arguments.insert(arguments.begin(), "$");
-		const auto [nameConstant, name] = m_allocator.allocateStringConstant(
-			std::string(className) + '.' + std::string(method->name));
-		const auto [functionConstant, function] =
-			m_allocator.allocateFunctionConstant(name, static_cast<int>(arguments.size()), &m_module->globals);
+		const auto [functionConstant, function] = createFunctionConstant(
+			std::string(className) + '.' + std::string(method->name), static_cast<int>(arguments.size()));
 
 		TRY(compileFunction(function, arguments, method->stmts, method->location()));
 
-		const auto methodNameConstant = m_allocator.allocateStringConstant(method->name).constant;
+		const auto methodNameConstant = createStringConstant(method->name);
 		TRY(loadConstant(functionConstant));
 		TRY(loadConstant(methodNameConstant));
 		emitOp(Op::StoreMethod);
@@ -501,7 +605,7 @@ Compiler::Status Compiler::classStmt(const ClassStmt& stmt)
 	if (m_scopes.size() > 0)
 		return errorAt(stmt.location(), "classes can only be created at global scope");
 
-	const auto [classNameConstant, className] = m_allocator.allocateStringConstant(stmt.name);
+	const auto classNameConstant = createStringConstant(stmt.name);
 
 	TRY(loadConstant(classNameConstant));
 	emitOp(Op::CreateClass);
@@ -558,6 +662,7 @@ Compiler::Status Compiler::matchStmt(const MatchStmt& stmt)
 			case StmtType::Ret: return true;
 			case StmtType::If: return true;
 			case StmtType::Loop: return true;
+			case StmtType::For: return true;
 			case StmtType::Break: return true;
 			case StmtType::Class: return false;
 			case StmtType::Impl: return false;
@@ -590,7 +695,7 @@ Compiler::Status Compiler::matchStmt(const MatchStmt& stmt)
 
 Compiler::Status Compiler::loadModule(std::string_view filePath)
 {
-	const auto filenameConstant = m_allocator.allocateStringConstant(filePath).constant;
+	const auto filenameConstant = createStringConstant(filePath);
 	TRY(loadConstant(filenameConstant));
 	emitOp(Op::Import);
 	emitOp(Op::ModuleSetLoaded);
@@ -686,11 +791,100 @@ Compiler::Status Compiler::compileBinaryExpr(const std::unique_ptr<Expr>& lhs, T
 		return Status::Ok;
 	}
 
+	if (op == TokenType::PlusPlus)
+	{
+		std::vector<const std::unique_ptr<Expr>*> parts;
+		concatParts(lhs, parts);
+		concatParts(rhs, parts);
+		if (parts.size() > 2)
+		{
+			for (const auto part : parts)
+			{
+				TRY(compile(*part));
+			}
+			emitOp(Op::ConcatN);
+			emitUint32(static_cast<uint32_t>(parts.size()));
+			return Status::Ok;
+		}
+	}
+
+	if (op == TokenType::Plus)
+	{
+		const auto lhsLocal = localIndex(*lhs);
+		const auto rhsLocal = localIndex(*rhs);
+		if (lhsLocal.has_value() && rhsLocal.has_value())
+		{
+			emitOp(Op::AddLocals);
+			emitUint32(*lhsLocal);
+			emitUint32(*rhsLocal);
+			return Status::Ok;
+		}
+	}
+
 	TRY(compile(lhs));
 	TRY(compile(rhs));
 	return compileBinaryExpr(op);
 }
 
+void Compiler::concatParts(const std::unique_ptr<Expr>& expr, std::vector<const std::unique_ptr<Expr>*>& parts)
+{
+	if (expr->type == ExprType::Binary)
+	{
+		const auto& binary = static_cast<const BinaryExpr&>(*expr);
+		if (binary.op == TokenType::PlusPlus)
+		{
+			concatParts(binary.lhs, parts);
+			concatParts(binary.rhs, parts);
+			return;
+		}
+	}
+	parts.push_back(&expr);
+}
+
+Compiler::Status Compiler::compileCondition(const std::unique_ptr<Expr>& condition)
+{
+	if (condition->type == ExprType::Binary)
+	{
+		const auto& expr = static_cast<const BinaryExpr&>(*condition);
+		std::optional<Op> op;
+		switch (expr.op)
+		{
+		case TokenType::Less: op = Op::LessLocalConstantJumpIfFalse; break;
+		case TokenType::LessEquals: op = Op::LessEqualLocalConstantJumpIfFalse; break;
+		case TokenType::More: op = Op::MoreLocalConstantJumpIfFalse; break;
+		case TokenType::MoreEquals: op = Op::MoreEqualLocalConstantJumpIfFalse; break;
+		default: break;
+		}
+
+		const auto local = localIndex(*expr.lhs);
+		if (op.has_value() && local.has_value())
+		{
+			if (const auto constant = numberConstant(*expr.rhs); constant.has_value())
+			{
+				emitOp(*op);
+				emitUint32(*local);
+				emitUint32(*constant);
+				return Status::Ok;
+			}
+		}
+	}
+	return compile(condition);
+}
+
+Compiler::Status Compiler::compileDiscarded(const std::unique_ptr<Expr>& expr)
+{
+	if (expr->type == ExprType::Assignment)
+	{
+		const auto& assignment = static_cast<const AssignmentExpr&>(*expr);
+		if (addLocalConstantAssignment(assignment))
+			return Status::Ok;
+	}
+
+	TRY(compile(expr));
+	emitOp(Op::PopStack);
+	return Status::Ok;
+}
+
 Compiler::Status Compiler::compileBinaryExpr(TokenType op)
 {
 	ASSERT(op != TokenType::AndAnd);
@@ -720,14 +914,14 @@ Compiler::Status Compiler::compileBinaryExpr(TokenType op)
 
 Compiler::Status Compiler::intConstantExpr(const IntConstantExpr& expr)
 {
-	auto constant = m_allocator.createConstant(Value(expr.value));
+	auto constant = createConstant(Value::intNum(expr.value, m_allocator));
 	TRY(loadConstant(constant));
 	return Status::Ok;
 }
 
 Compiler::Status Compiler::floatConstantExpr(const FloatConstantExpr& expr)
 {
-	auto constant = m_allocator.createConstant(Value(expr.value));
+	auto constant = createConstant(Value(expr.value));
 	TRY(loadConstant(constant));
 	return Status::Ok;
 }
@@ -753,7 +947,7 @@ Compiler::Status Compiler::nullExpr(const NullExpr&)
 
 Compiler::Status Compiler::stringConstantExpr(const StringConstantExpr& expr)
 {
-	const auto constant = m_allocator.allocateStringConstant(expr.text, expr.length).constant;
+	const auto constant = createStringConstant(expr.text, expr.length);
 	TRY(loadConstant(constant));
 	return Status::Ok;
 }
@@ -818,12 +1012,12 @@ Compiler::Status Compiler::assignmentExpr(const AssignmentExpr& expr)
 	{
 		const auto lhs = static_cast<GetFieldExpr*>(expr.lhs.get());
 		TRY(compile(lhs->lhs));
-		const auto fieldNameConstant = m_allocator.allocateStringConstant(lhs->fieldName).constant;
+		const auto fieldNameConstant = createStringConstant(lhs->fieldName);
 		TRY(loadConstant(fieldNameConstant));
 		if (expr.op.has_value())
 		{
 			emitOp(Op::CloneTopTwo);
-			emitOp(Op::GetField);
+			emitFieldOp(Op::GetField);
 			TRY(compile(expr.rhs));
 			TRY(compileBinaryExpr(*expr.op));
 		}
@@ -831,7 +1025,7 @@ Compiler::Status Compiler::assignmentExpr(const AssignmentExpr& expr)
 		{
 			TRY(compile(expr.rhs));
 		}
-		emitOp(Op::SetField);
+		emitFieldOp(Op::SetField);
 		return Status::Ok;
 	}
 	else if (expr.lhs->type == ExprType::Identifier)
@@ -851,14 +1045,36 @@ Compiler::Status Compiler::assignmentExpr(const AssignmentExpr& expr)
 
 Compiler::Status Compiler::callExpr(const CallExpr& expr)
 {
-	// TODO: Add an optimization for calling on instance fields.
+	// Method calls don't need to create a bound function.
+	if (expr.calle->type == ExprType::GetField)
+	{
+		const auto calle = static_cast<GetFieldExpr*>(expr.calle.get());
+		TRY(compile(calle->lhs));
+		for (const auto& argument : expr.arguments)
+		{
+			TRY(compile(argument));
+		}
+		const auto methodNameConstant = createStringConstant(calle->fieldName);
+		if (methodNameConstant > UINT32_MAX)
+			return Status::Error;
+		emitFieldOp(Op::Invoke);
+		emitUint32(static_cast<uint32_t>(methodNameConstant));
+		emitUint32(static_cast<uint32_t>(expr.arguments.size()));
+		return Status::Ok;
+	}
+
+	return compileCall(expr, Op::Call);
+}
+
+Compiler::Status Compiler::compileCall(const CallExpr& expr, Op callOp)
+{
 	TRY(compile(expr.calle));
 
 	for (const auto& argument : expr.arguments)
 	{
 		TRY(compile(argument));
 	}
-	emitOp(Op::Call);
+	emitOp(callOp);
 	emitUint32(static_cast<uint32_t>(expr.arguments.size()));
 
 	return Status::Ok;
@@ -893,9 +1109,8 @@ Compiler::Status Compiler::dictExpr(const DictExpr& expr)
 Compiler::Status Compiler::lambdaExpr(const LambdaExpr& expr)
 {
 	static constexpr std::string_view ANONYMOUS_FUNCTION_NAME = "";
-	const auto [nameConstant, name] = m_allocator.allocateStringConstant(ANONYMOUS_FUNCTION_NAME);
 	const auto [functionConstant, function] =
-		m_allocator.allocateFunctionConstant(name, static_cast<int>(expr.arguments.size()), &m_module->globals);
+		createFunctionConstant(ANONYMOUS_FUNCTION_NAME, static_cast<int>(expr.arguments.size()));
 	TRY(loadConstant(functionConstant));
 	TRY(compileFunction(function, expr.arguments, expr.stmts, expr.location()));
 	return Status::Ok;
@@ -1042,8 +1257,8 @@ Compiler::Status Compiler::createVariableImplementation(std::string_view name, c
 {
 	if (m_scopes.size() == 0)
 	{
-		TRY(loadConstant(m_allocator.allocateStringConstant(name).constant));
 		emitOp(Op::CreateGlobal);
+		emitUint32(m_module->globals.slotIndex(m_allocator.allocateStringConstant(name)));
 		return Status::Ok;
 	}
 
@@ -1053,16 +1268,8 @@ Compiler::Status Compiler::createVariableImplementation(std::string_view name, c
 	{
 		return errorAt(location, "redeclaration of variable '%.*s'", name.size(), name.data());
 	}
-	// TODO: Make this better maybe change scopes to store the count or maybe store it with a local.
-	size_t localsCount = 0;
-	const auto functionDepth = currentScope().functionDepth;
-	for (auto scope = m_scopes.crbegin(); scope != m_scopes.crend(); scope++)
-	{
-		if (scope->functionDepth != functionDepth)
-			break;
-		localsCount += scope->localVariables.size();
-	}
-	locals[name] = Local{ static_cast<uint32_t>(localsCount), false };
+	const auto index = static_cast<uint32_t>(localsCount());
+	locals[name] = Local{ index, false };
 
 	return Status::Ok;
 }
@@ -1139,15 +1346,80 @@ Compiler::Status Compiler::variable(std::string_view name, bool trueIfLoadFalseI
 		}
 	}
 
-	const auto constant = m_allocator.allocateStringConstant(name).constant;
-	TRY(loadConstant(constant));
+	// The slot is created even if the global isn't defined yet, because it might be defined before this code runs.
 	if (trueIfLoadFalseIfSet)
 		emitOp(Op::GetGlobal);
 	else
 		emitOp(Op::SetGlobal);
+	emitUint32(m_module->globals.slotIndex(m_allocator.allocateStringConstant(name)));
 	return Status::Ok;
 }
 
+std::optional<uint32_t> Compiler::localIndex(const Expr& expr)
+{
+	if (expr.type != ExprType::Identifier)
+		return std::nullopt;
+
+	const auto name = static_cast<const IdentifierExpr&>(expr).identifier;
+	for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); it++)
+	{
+		const auto local = it->localVariables.find(name);
+		if (local == it->localVariables.end())
+			continue;
+
+		if (it->functionDepth != currentFunctionDepth())
+			return std::nullopt;
+		return local->second.index;
+	}
+	return std::nullopt;
+}
+
+std::optional<uint32_t> Compiler::numberConstant(const Expr& expr)
+{
+	size_t constant;
+	if (expr.type == ExprType::IntConstant)
+		constant = createConstant(Value::intNum(static_cast<const IntConstantExpr&>(expr).value, m_allocator));
+	else if (expr.type == ExprType::FloatConstant)
+		constant = createConstant(Value(static_cast<const FloatConstantExpr&>(expr).value));
+	else
+		return std::nullopt;
+
+	if (constant > UINT32_MAX)
+		return std::nullopt;
+	return static_cast<uint32_t>(constant);
+}
+
+bool Compiler::addLocalConstantAssignment(const AssignmentExpr& expr)
+{
+	const auto local = localIndex(*expr.lhs);
+	if ((local.has_value() == false)
+		|| (canVariableBeCreatedAndAssigned(static_cast<const IdentifierExpr&>(*expr.lhs).identifier) == false))
+		return false;
+
+	std::optional<uint32_t> constant;
+	if (expr.op.has_value())
+	{
+		if (*expr.op == TokenType::Plus)
+			constant = numberConstant(*expr.rhs);
+	}
+	else if (expr.rhs->type == ExprType::Binary)
+	{
+		const auto& binary = static_cast<const BinaryExpr&>(*expr.rhs);
+		if ((binary.op == TokenType::Plus) && (localIndex(*binary.lhs) == local))
+			constant = numberConstant(*binary.rhs);
+	}
+	if (constant.has_value() == false)
+		return false;
+
+	emitOp(Op::AddLocalConstant);
+	emitUint32(*local);
+	emitUint32(*constant);
+	emitOp(Op::SetLocal);
+	emitUint32(*local);
+	emitOp(Op::PopStack);
+	return true;
+}
+
 Compiler::Status Compiler::loadVariable(std::string_view name)
 {
 	return variable(name, true);
@@ -1162,9 +1434,9 @@ Compiler::Status Compiler::setVariable(std::string_view name, const SourceLocati
 
 Compiler::Status Compiler::getField(std::string_view fieldName)
 {
-	const auto fieldNameConstant = m_allocator.allocateStringConstant(fieldName).constant;
+	const auto fieldNameConstant = createStringConstant(fieldName);
 	TRY(loadConstant(fieldNameConstant));
-	emitOp(Op::GetField);
+	emitFieldOp(Op::GetField);
 	return Status::Ok;
 }
 
@@ -1177,6 +1449,52 @@ Compiler::Status Compiler::loadConstant(size_t index)
 	return Status::Ok;
 }
 
+size_t Compiler::createConstant(const Value& value)
+{
+	auto& function = m_functions.back();
+	auto& constants = function.function->byteCode.constants;
+	const auto newIndex = constants.size();
+	auto index = newIndex;
+	if (value.isInt())
+	{
+		index = function.intConstants.try_emplace(value.asInt(), newIndex).first->second;
+	}
+	else if (value.isFloat())
+	{
+		const auto number = value.asFloat();
+		uint64_t bits;
+		static_assert(sizeof(bits) == sizeof(number));
+		memcpy(&bits, &number, sizeof(bits));
+		index = function.floatConstants.try_emplace(bits, newIndex).first->second;
+	}
+	else if (value.isObj() && value.asObj()->isString())
+	{
+		index = function.stringConstants.try_emplace(value.asObj()->asString(), newIndex).first->second;
+	}
+
+	if (index == newIndex)
+		constants.push_back(value);
+	return index;
+}
+
+size_t Compiler::createStringConstant(std::string_view chars)
+{
+	return createConstant(Value(m_allocator.allocateString(chars)));
+}
+
+size_t Compiler::createStringConstant(std::string_view chars, size_t length)
+{
+	return createConstant(Value(m_allocator.allocateString(chars, length)));
+}
+
+Compiler::FunctionConstant Compiler::createFunctionConstant(std::string_view name, int argCount)
+{
+	// Allocating the function might run the gc so the name has to be a constant.
+	const auto nameString = m_allocator.allocateStringConstant(name);
+	const auto function = m_allocator.allocateFunction(nameString, argCount, &m_module->globals);
+	return { createConstant(Value(function)), function };
+}
+
 ByteCode& Compiler::currentByteCode()
 {
 	return *m_functionByteCodeStack.back();
@@ -1206,6 +1524,13 @@ void Compiler::emitUint8(uint8_t value)
 	code.lineNumberAtOffset.push_back(m_lineNumberStack.back());
 }
 
+void Compiler::emitFieldOp(Op op)
+{
+	emitOp(op);
+	// The inline cache index is assigned when the function is first called.
+	emitUint32(0);
+}
+
 void Compiler::emitUint32(uint32_t value)
 {
 	auto& code = currentByteCode();
@@ -1321,17 +1646,13 @@ void Compiler::popOffLocals(const Scope& scope)
 void Compiler::scopeCleanUp(const Scope& scope)
 {
 	popOffLocals(scope);
-	if (scope.type == ScopeType::Try)
-	{
-		emitOp(Op::TryEnd);
-	}
-	else if (scope.type == ScopeType::Finally)
+	if (scope.type == ScopeType::Finally)
 	{
 		emitOp(Op::FinallyEnd);
 	}
 }
 
-Compiler::Status Compiler::cleanUpBeforeJumpingOutOfScope(const Scope& scope, bool popOffLocals)
+Compiler::Status Compiler::cleanUpBeforeJumpingOutOfScope(Scope& scope, bool popOffLocals)
 {
 	if (popOffLocals)
 	{
@@ -1340,7 +1661,7 @@ Compiler::Status Compiler::cleanUpBeforeJumpingOutOfScope(const Scope& scope, bo
 
 	if ((scope.type == ScopeType::Try))
 	{
-		emitOp(Op::TryEnd);
+		endProtectedRange(scope);
 		currentByteCode().append(*scope.try_.finallyBlockByteCode);
 	}
 	else if ((scope.type == ScopeType::Catch))
@@ -1350,6 +1671,66 @@ Compiler::Status Compiler::cleanUpBeforeJumpingOutOfScope(const Scope& scope, bo
 	return Status::Ok;
 }
 
+void Compiler::beginTryScope(ByteCode* finallyBlockByteCode)
+{
+	beginScope(ScopeType::Try);
+	auto& scope = currentScope();
+	scope.try_.finallyBlockByteCode = finallyBlockByteCode;
+	scope.try_.protectedCodeBegin = currentLocation();
+	scope.try_.stackSize = localsCount();
+}
+
+std::vector<ByteCode::ExceptionHandler> Compiler::endTryScope()
+{
+	endProtectedRange(currentScope());
+	auto protectedRanges = std::move(currentScope().protectedRanges);
+	endScope();
+	return protectedRanges;
+}
+
+void Compiler::setExceptionHandlerToHere(std::vector<ByteCode::ExceptionHandler>& protectedRanges)
+{
+	// The inner try blocks set their handlers first so they come before the outer ones.
+	for (auto& range : protectedRanges)
+	{
+		range.handlerOffset = currentLocation();
+		currentByteCode().exceptionHandlers.push_back(range);
+	}
+}
+
+void Compiler::endProtectedRange(Scope& scope)
+{
+	const auto begin = scope.try_.protectedCodeBegin;
+	const auto end = currentLocation();
+	if (begin != end)
+	{
+		scope.protectedRanges.push_back(ByteCode::ExceptionHandler{ begin, end, 0, scope.try_.stackSize });
+	}
+}
+
+void Compiler::reopenProtectedRanges(size_t firstScope)
+{
+	for (auto i = firstScope; i < m_scopes.size(); i++)
+	{
+		if (m_scopes[i].type == ScopeType::Try)
+			m_scopes[i].try_.protectedCodeBegin = currentLocation();
+	}
+}
+
+size_t Compiler::localsCount()
+{
+	// TODO: Make this better maybe change scopes to store the count or maybe store it with a local.
+	size_t count = 0;
+	const auto functionDepth = currentScope().functionDepth;
+	for (auto scope = m_scopes.crbegin(); scope != m_scopes.crend(); scope++)
+	{
+		if (scope->functionDepth != functionDepth)
+			break;
+		count += scope->localVariables.size();
+	}
+	return count;
+}
+
 bool Compiler::canVariableBeCreatedAndAssigned(std::string_view name)
 {
 	if (name.size() > 0)
@@ -1373,4 +1754,13 @@ void Compiler::mark(Compiler* compiler, Allocator& allocator)
 	{
 		allocator.addObj(compiler->m_module);
 	}
+	if (compiler->m_program != nullptr)
+	{
+		allocator.addObj(compiler->m_program);
+	}
+	// The function that is being compiled might not be in any constant pool yet.
+	for (const auto& function : compiler->m_functions)
+	{
+		allocator.addObj(function.function);
+	}
 }
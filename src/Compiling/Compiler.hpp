@@ -80,12 +80,18 @@ private:
 			struct  
 			{
 				ByteCode* finallyBlockByteCode;
+				// Start of the protected range that is currently being compiled.
+				size_t protectedCodeBegin;
+				size_t stackSize;
 			} try_;
 			struct
 			{
 				ByteCode* finallyBlockByteCode;
 			} catch_;
 		};
+		// Only used by try scopes. The code jumping out of the scope isn't protected by the handler so the try block
+		// might be split into multiple ranges.
+		std::vector<ByteCode::ExceptionHandler> protectedRanges;
 	};
 
 	struct Loop
@@ -105,7 +111,19 @@ private:
 
 	struct Function
 	{
+		ObjFunction* function;
 		std::vector<Upvalue> upvalues;
+		// Indices of the constants in the function's pool used to deduplicate them. Floats are stored as bits so
+		// 0.0 and -0.0 are different constants. Strings are interned so they can be compared by pointer.
+		std::unordered_map<Int, size_t> intConstants;
+		std::unordered_map<uint64_t, size_t> floatConstants;
+		std::unordered_map<const ObjString*, size_t> stringConstants;
+	};
+
+	struct FunctionConstant
+	{
+		size_t constant;
+		ObjFunction* function;
 	};
 
 	struct StatementExpression
@@ -140,6 +158,9 @@ private:
 	Status retStmt(const RetStmt& stmt);
 	Status ifStmt(const IfStmt& stmt);
 	Status loopStmt(const LoopStmt& stmt);
+	Status forStmt(const ForStmt& stmt);
+	// Returns the call if the for loop iterable is Range(start, end). The vm checks if Range is the builtin.
+	static const CallExpr* countedLoopRange(const Expr& iterable);
 	Status breakStmt(const BreakStmt& stmt);
 	Status compileMethods(std::string_view className, const std::vector<std::unique_ptr<FnStmt>>& methods);
 	Status classStmt(const ClassStmt& stmt);
@@ -157,6 +178,14 @@ private:
 	Status compileBinaryExpr(const std::unique_ptr<Expr>& lhs, TokenType op, const std::unique_ptr<Expr>& rhs);
 	// [lhs, rhs] -> [result].
 	Status compileBinaryExpr(TokenType op);
+	// Appends the operands of a chain of concatenations in evaluation order. Concatenation is associative so the
+	// parenthesization doesn't matter.
+	static void concatParts(const std::unique_ptr<Expr>& expr, std::vector<const std::unique_ptr<Expr>*>& parts);
+	// [] -> [condition]
+	// Has to be followed by JumpIfFalseAndPop, because the comparison might be fused with it.
+	Status compileCondition(const std::unique_ptr<Expr>& condition);
+	// [] -> []
+	Status compileDiscarded(const std::unique_ptr<Expr>& expr);
 	// TODO: perform constant folding
 	Status intConstantExpr(const IntConstantExpr& expr);
 	Status floatConstantExpr(const FloatConstantExpr& expr);
@@ -167,6 +196,8 @@ private:
 	Status unaryExpr(const UnaryExpr& expr);
 	Status identifierExpr(const IdentifierExpr& expr);
 	Status callExpr(const CallExpr& expr);
+	// Compiles a call that isn't a method call using callOp, which is either Call or TailCall.
+	Status compileCall(const CallExpr& expr, Op callOp);
 	Status assignmentExpr(const AssignmentExpr& expr);
 	Status listExpr(const ListExpr& expr);
 	Status dictExpr(const DictExpr& expr);
@@ -190,19 +221,42 @@ private:
 	Scope& currentScope();
 	void popOffLocals(const Scope& scope);
 	void scopeCleanUp(const Scope& scope);
-	Status cleanUpBeforeJumpingOutOfScope(const Scope& scope, bool popOffLocals);
+	Status cleanUpBeforeJumpingOutOfScope(Scope& scope, bool popOffLocals);
+	void beginTryScope(ByteCode* finallyBlockByteCode);
+	// Returns the protected ranges of the try block. The handler location is set later using setExceptionHandlerToHere.
+	std::vector<ByteCode::ExceptionHandler> endTryScope();
+	void setExceptionHandlerToHere(std::vector<ByteCode::ExceptionHandler>& protectedRanges);
+	void endProtectedRange(Scope& scope);
+	// Has to be called after emitting the jump out of the scopes starting at firstScope.
+	void reopenProtectedRanges(size_t firstScope);
+	// Number of locals of the current function.
+	size_t localsCount();
 	static bool canVariableBeCreatedAndAssigned(std::string_view name);
 	Status variable(std::string_view name, bool trueIfLoadFalseIfSet);
+	// Returns the index if the expr is a local variable of the current function.
+	std::optional<uint32_t> localIndex(const Expr& expr);
+	// Returns the constant index if the expr is a number literal.
+	std::optional<uint32_t> numberConstant(const Expr& expr);
+	// Compiles x = x + constant and x += constant into AddLocalConstant. Returns false if nothing was emitted.
+	bool addLocalConstantAssignment(const AssignmentExpr& expr);
 	Status loadVariable(std::string_view name);
 	Status setVariable(std::string_view name, const SourceLocation& location);
 	// [value] -> [field]
 	Status getField(std::string_view fieldName);
 	Status loadConstant(size_t index);
+	// Adds the value to the constant pool of the current function. Functions are never deduplicated.
+	size_t createConstant(const Value& value);
+	size_t createStringConstant(std::string_view chars);
+	size_t createStringConstant(std::string_view chars, size_t length);
+	// Allocates a function and adds it to the constant pool of the current function, which keeps it alive.
+	FunctionConstant createFunctionConstant(std::string_view name, int argCount);
 	ByteCode& currentByteCode();
 	void emitOp(Op op);
 	Status emitOpArg(Op op, size_t arg, const SourceLocation& location);
 	void emitUint8(uint8_t value);
 	void emitUint32(uint32_t value);
+	// Emits GetField, SetField or Invoke.
+	void emitFieldOp(Op op);
 	// Could make a class RAII class that reports an error if the jump was not set at the end of the scope.
 	// This would be needed if the compiler could synchronize.
 	size_t emitJump(Op op);
@@ -214,7 +268,6 @@ private:
 
 	Status errorAt(const SourceLocation& location, const char* format, ...);
 
-	// If only constants are allocated by the compiler the marking function probably isn't needed.
 	static void mark(Compiler* compiler, Allocator& allocator);
 
 public:
@@ -235,6 +288,8 @@ public:
 
 
 	ObjModule* m_module;
+	// The last compiled program. Kept alive until the next compilation so it isn't freed before it is called.
+	ObjFunction* m_program;
 	Allocator::MarkingFunctionHandle m_rootMarkingFunctionHandle;
 
 	bool m_hadError;
@@ -25,18 +25,14 @@ size_t LocalObjString::size() const
 }
 
 LocalValue::LocalValue(const Value& value, Context& context)
-	: value(value)
+	: value(context.allocator.allocateHandle(value))
 	, m_context(context)
-{
-	m_context.allocator.registerLocal(&this->value);
-}
+{}
 
 LocalValue::LocalValue(const LocalValue& other)
-	: value(other.value)
+	: value(other.m_context.allocator.allocateHandle(other.value))
 	, m_context(other.m_context)
-{
-	m_context.allocator.registerLocal(&this->value);
-}
+{}
 
 LocalValue::LocalValue(std::string_view string, Context& context)
 	: LocalValue(Value(context.allocator.allocateString(string)), context)
@@ -46,16 +42,12 @@ LocalValue::LocalValue(std::string_view string, Context& context)
 LocalValue& LocalValue::operator=(const LocalValue & other)
 {
 	value = other.value;
-}
-
-LocalValue::~LocalValue()
-{
-	m_context.allocator.unregisterLocal(&value);
+	return *this;
 }
 
 LocalValue LocalValue::intNum(Int value, Context& context)
 {
-	return LocalValue(Value::intNum(value), context);
+	return LocalValue(Value::intNum(value, context.allocator), context);
 }
 
 LocalValue LocalValue::floatNum(Float value, Context& context)
@@ -75,6 +67,9 @@ LocalValue LocalValue::null(Context& context)
 
 bool LocalValue::operator==(const LocalValue& other)
 {
+	if (const auto result = Vm::primitiveEquals(value, other.value); result.has_value())
+		return *result;
+
 	auto& vm = m_context.vm;
 	if ((vm.m_stack.push(value) == false)|| (vm.m_stack.push(other.value) == false))
 	{
@@ -109,12 +104,12 @@ void LocalValue::set(std::string_view fieldName, const LocalValue& rhs)
 
 LocalObjString LocalValue::asString()
 {
-	auto obj = value.as.obj;
-	if ((value.isObj() == false) || (obj->isString() == false))
+	m_context.vm.flattenRope(value);
+	if ((value.isObj() == false) || (value.asObj()->isString() == false))
 	{
 		TRY(m_context.vm.throwTypeErrorExpectedFound(m_context.vm.m_stringType, value));
 	}
-	return LocalObjString(obj->asString(), m_context);
+	return LocalObjString(value.asObj()->asString(), m_context);
 }
 
 bool LocalValue::isInt() const
@@ -136,7 +131,7 @@ bool LocalValue::isBool() const
 bool LocalValue::asBool() const
 {
 	ASSERT(isBool());
-	return value.as.boolean;
+	return value.asBool();
 }
 
 bool LocalValue::isFloat() const
@@ -147,7 +142,7 @@ bool LocalValue::isFloat() const
 Float LocalValue::asFloat() const
 {
 	ASSERT(isFloat());
-	return value.as.floatNumber;
+	return value.asFloat();
 }
 
 bool LocalValue::isNumber() const
@@ -169,10 +164,10 @@ Float LocalValue::asNumber() const
 }
 
 Context::Context(Value* args, int argCount, Allocator& allocator, Vm& vm, void* data)
-	: m_args(args)
-	, m_argCount(argCount)
-	, allocator(allocator)
+	: allocator(allocator)
 	, vm(vm)
+	, m_argsStackIndex(static_cast<size_t>(args - vm.m_stack.data()))
+	, m_argCount(argCount)
 	, data(data)
 {}
 
@@ -186,7 +181,7 @@ LocalValue Context::args(size_t index)
 		throw NativeException(LocalValue::null(*this));
 	}
 
-	return LocalValue(m_args[i], *this);
+	return LocalValue(vm.m_stack[m_argsStackIndex + index], *this);
 }
 
 std::optional<LocalValue> Context::at(std::string_view name)
@@ -210,12 +205,12 @@ LocalValue Context::get(std::string_view name)
 
 void Context::set(std::string_view name, const LocalValue& value)
 {
-	vm.m_globals->set(allocator.allocateStringConstant(name).value, value.value);
+	vm.m_globals->set(allocator.allocateStringConstant(name), value.value);
 }
 
 void Context::createFunction(std::string_view name, NativeFunction function, int argCount, void* context)
 {
-	const auto nameString = allocator.allocateStringConstant(name).value;
+	const auto nameString = allocator.allocateStringConstant(name);
 	ASSERT(argCount >= 0);
 	vm.m_globals->set(
 		nameString, 
@@ -224,7 +219,7 @@ void Context::createFunction(std::string_view name, NativeFunction function, int
 
 void Context::useAllFromModule(std::string_view name)
 {
-	const auto nameString = allocator.allocateStringConstant(name).value;
+	const auto nameString = allocator.allocateStringConstant(name);
 	TRY(vm.importModule(nameString));
 	auto module = vm.m_stack.top();
 	module.asObj()->asModule()->isLoaded = true;
@@ -234,7 +229,7 @@ void Context::useAllFromModule(std::string_view name)
 
 LocalValue Context::useModule(std::string_view name, std::optional<std::string_view> variableName)
 {
-	const auto nameString = allocator.allocateStringConstant(name).value;
+	const auto nameString = allocator.allocateStringConstant(name);
 	TRY(vm.importModule(nameString));
 	auto module = vm.m_stack.top();
 	vm.m_stack.pop();
@@ -242,7 +237,7 @@ LocalValue Context::useModule(std::string_view name, std::optional<std::string_v
 
 	if (variableName.has_value())
 	{
-		const auto variableNameString = allocator.allocateStringConstant(*variableName).value;
+		const auto variableNameString = allocator.allocateStringConstant(*variableName);
 		vm.m_globals->set(variableNameString, module);
 	}
 	else
@@ -4,7 +4,9 @@
 #include <ContextTry.hpp>
 #include <iostream>
 
-// No operator= needed for types becuase the only thing they need to manage is is their pointer registred and unregistred from the allocator.
+// LocalValue and LocalObj are rooted using handles allocated in the current Allocator::HandleScope, so they can't be
+// used after the scope ends. The vm creates a scope for every native function call. Natives that create a lot of
+// temporary values in a loop can create their own scopes.
 
 namespace Voxl
 {
@@ -21,7 +23,6 @@ class LocalObj
 public:
 	LocalObj(T* obj, Context& context);
 	LocalObj(LocalObj& other);
-	~LocalObj();
 	T* operator->();
 	const T* operator->() const;
 
@@ -58,7 +59,6 @@ public:
 	LocalValue(const LocalValue& other);
 	LocalValue(std::string_view string, Context& context);
 	LocalValue& operator= (const LocalValue& other);
-	~LocalValue();
 
 	// Could implement getting fields by returing a object that could be assigned which would set the field
 	// and get the field. The get field would be called on the implicit converion to LocalValue and
@@ -92,17 +92,19 @@ public:
 	Float asNumber() const;
 
 public:
-	Value value;
+	// Refers to the handle.
+	Value& value;
 private:
 	Context& m_context;
 };
 
+// The GC doesn't move objects so the handle only needs to keep the object alive.
 template<typename T>
 LocalObj<T>::LocalObj(T* obj, Context& context)
 	: obj(obj)
 	, m_context(context)
 {
-	m_context.allocator.registerLocal(reinterpret_cast<Obj**>(&this->obj));
+	m_context.allocator.allocateHandle(Value(reinterpret_cast<Obj*>(obj)));
 }
 
 template<typename T>
@@ -110,13 +112,7 @@ LocalObj<T>::LocalObj(LocalObj& other)
 	: obj(other.obj)
 	, m_context(other.m_context)
 {
-	m_context.allocator.registerLocal(reinterpret_cast<Obj**>(&this->obj));
-}
-
-template<typename T>
-LocalObj<T>::~LocalObj()
-{
-	m_context.allocator.unregisterLocal(reinterpret_cast<Obj**>(&this->obj));
+	m_context.allocator.allocateHandle(Value(reinterpret_cast<Obj*>(obj)));
 }
 
 template<typename T>
@@ -158,7 +154,8 @@ public:
 	Vm& vm;
 //private:
 public:
-	Value* const m_args;
+	// Not storing a pointer, because the stack might grow if the function calls back into the vm.
+	const size_t m_argsStackIndex;
 	const int m_argCount;
 	void* data;
 };
@@ -171,7 +168,7 @@ void Context::createClass(
 	FreeFunction<T> free, 
 	void* context)
 {
-	auto className = allocator.allocateStringConstant(name).value;
+	auto className = allocator.allocateStringConstant(name);
 	auto class_ = allocator.allocateNativeClass(className, methods, vm.m_globals, init, free, context);
 	vm.m_globals->set(className, Value(class_));
 }
@@ -201,14 +198,13 @@ LocalValue LocalValue::operator()(const Vals&&... args)
 template<typename T>
 LocalObj<T> LocalValue::asObj()
 {
-	auto obj = value.as.obj;
 	if ((value.isObj() == false)
-		|| (obj->isNativeInstance() == false) 
-		|| (obj->asNativeInstance()->isOfType<T>() == false))
+		|| (value.asObj()->isNativeInstance() == false) 
+		|| (value.asObj()->asNativeInstance()->isOfType<T>() == false))
 	{
 		TRY(m_context.vm.throwErrorWithMsg(m_context.vm.m_typeErrorType, "unexpected type"));
 	}
-	return LocalObj<T>(reinterpret_cast<T*>(obj), m_context);
+	return LocalObj<T>(reinterpret_cast<T*>(value.asObj()), m_context);
 }
 
 }
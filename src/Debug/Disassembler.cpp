@@ -1,5 +1,5 @@
 #include <Debug/Disassembler.hpp>
-#include <Value.hpp>
+#include <Obj.hpp>
 #include <Asserts.hpp>
 
 #include <iostream>
@@ -26,7 +26,7 @@ static size_t opNumber(std::string_view name, const ByteCode& byteCode, size_t o
 	return 5;
 }
 
-static size_t opConstant(std::string_view name, const ByteCode& byteCode, size_t offset, const Allocator& allocator)
+static size_t opConstant(std::string_view name, const ByteCode& byteCode, size_t offset)
 {
 	std::cout << name;
 	uint32_t index = 0;
@@ -37,11 +37,62 @@ static size_t opConstant(std::string_view name, const ByteCode& byteCode, size_t
 	}
 	// Justify left later
 	std::cout << " c[" << index << "] -> ";
-	const auto& constant = allocator.getConstant(index);
+	const auto& constant = byteCode.constants[index];
 	debugPrintValue(constant);
 	return 5;
 }
 
+static size_t localLocalOp(std::string_view name, const ByteCode& byteCode, size_t offset)
+{
+	std::cout << name;
+	uint32_t operands[2] = { 0, 0 };
+	for (size_t operand = 0; operand < 2; operand++)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			operands[operand] <<= 8;
+			operands[operand] |= byteCode.code[offset + 1 + operand * 4 + i];
+		}
+	}
+	std::cout << ' ' << operands[0] << ' ' << operands[1];
+	return 9;
+}
+
+static size_t localConstantOp(std::string_view name, const ByteCode& byteCode, size_t offset)
+{
+	std::cout << name;
+	uint32_t operands[2] = { 0, 0 };
+	for (size_t operand = 0; operand < 2; operand++)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			operands[operand] <<= 8;
+			operands[operand] |= byteCode.code[offset + 1 + operand * 4 + i];
+		}
+	}
+	std::cout << ' ' << operands[0] << " c[" << operands[1] << "] -> ";
+	debugPrintValue(byteCode.constants[operands[1]]);
+	return 9;
+}
+
+static size_t invokeOp(std::string_view name, const ByteCode& byteCode, size_t offset)
+{
+	std::cout << name;
+	uint32_t operands[3] = { 0, 0, 0 };
+	for (size_t operand = 0; operand < 3; operand++)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			operands[operand] <<= 8;
+			operands[operand] |= byteCode.code[offset + 1 + operand * 4 + i];
+		}
+	}
+	std::cout << ' ' << operands[0] << " c[" << operands[1] << "] -> ";
+	debugPrintValue(byteCode.constants[operands[1]]);
+	std::cout << " args " << operands[2];
+	return 13;
+}
+
 static size_t jump(std::string_view name, const ByteCode& byteCode, size_t offset, int sign)
 {
 	std::cout << name;
@@ -81,7 +132,7 @@ static size_t closeUpvalueOp(std::string name, const ByteCode& byteCode, size_t
 
 void Voxl::debugPrintValue(const Value& value)
 {
-	if ((value.type == ValueType::Obj) && (value.as.obj->type == ObjType::String))
+	if (value.isObj() && (value.asObj()->type == ObjType::String))
 	{
 		std::cout << '"' << value << '"';
 	}
@@ -91,7 +142,7 @@ void Voxl::debugPrintValue(const Value& value)
 	}
 }
 
-size_t Voxl::disassembleInstruction(const ByteCode& byteCode, size_t offset, const Allocator& allocator)
+size_t Voxl::disassembleInstruction(const ByteCode& byteCode, size_t offset)
 {
 	std::cout << std::left << std::setw(5) << offset;
 	if ((offset > 0) && (byteCode.lineNumberAtOffset[offset] == byteCode.lineNumberAtOffset[offset - 1]))
@@ -116,21 +167,19 @@ size_t Voxl::disassembleInstruction(const ByteCode& byteCode, size_t offset, con
 		case Op::More: return justOp("more");
 		case Op::MoreEqual: return justOp("moreEqual");
 		case Op::Throw: return justOp("throw");
-		case Op::TryBegin: return opNumber("tryBegin", byteCode, offset);
-		case Op::TryEnd: return justOp("tryEnd");
 		case Op::CreateClass: return justOp("createClass");
-		case Op::GetField: return justOp("getProperty");
-		case Op::SetField: return justOp("setProperty");
+		case Op::GetField: return opNumber("getProperty", byteCode, offset);
+		case Op::SetField: return opNumber("setProperty", byteCode, offset);
 		case Op::StoreMethod: return justOp("storeMethod");
 		case Op::Concat: return justOp("concat");
 		case Op::Equals: return justOp("equals");
-		case Op::GetConstant: return opConstant("loadConstant", byteCode, offset, allocator);
+		case Op::GetConstant: return opConstant("loadConstant", byteCode, offset);
 		case Op::GetLocal: return opNumber("loadLocal", byteCode, offset);
 		case Op::SetLocal: return opNumber("setLocal", byteCode, offset);
 		case Op::Call: return opNumber("call", byteCode, offset);
-		case Op::GetGlobal: return justOp("loadGlobal");
-		case Op::SetGlobal: return justOp("setGlobal");
-		case Op::CreateGlobal: return justOp("createGlobal");
+		case Op::GetGlobal: return opNumber("loadGlobal", byteCode, offset);
+		case Op::SetGlobal: return opNumber("setGlobal", byteCode, offset);
+		case Op::CreateGlobal: return opNumber("createGlobal", byteCode, offset);
 		case Op::JumpIfFalse: return jump("jumpIfFalse", byteCode, offset, 1);
 		case Op::JumpIfTrue: return jump("jumpIfTrue", byteCode, offset, 1);
 		case Op::JumpIfFalseAndPop: return jump("jumpIfFalseAndPop", byteCode, offset, 1);
@@ -163,19 +212,53 @@ size_t Voxl::disassembleInstruction(const ByteCode& byteCode, size_t offset, con
 		case Op::DictSet: return justOp("dictSet");
 		case Op::Rethrow: return justOp("rethrow");
 		case Op::Inherit: return justOp("opInherit");
+		case Op::Invoke: return invokeOp("invoke", byteCode, offset);
 		case Op::ExpressionStatementBegin: return justOp("expressionStatementBegin");
 		case Op::ExpressionStatementReturn: return justOp("expresionStatementReturn");
+		case Op::AddInt: return justOp("addInt");
+		case Op::AddFloat: return justOp("addFloat");
+		case Op::SubtractInt: return justOp("subtractInt");
+		case Op::SubtractFloat: return justOp("subtractFloat");
+		case Op::MultiplyInt: return justOp("multiplyInt");
+		case Op::MultiplyFloat: return justOp("multiplyFloat");
+		case Op::LessInt: return justOp("lessInt");
+		case Op::LessFloat: return justOp("lessFloat");
+		case Op::LessEqualInt: return justOp("lessEqualInt");
+		case Op::LessEqualFloat: return justOp("lessEqualFloat");
+		case Op::MoreInt: return justOp("moreInt");
+		case Op::MoreFloat: return justOp("moreFloat");
+		case Op::MoreEqualInt: return justOp("moreEqualInt");
+		case Op::MoreEqualFloat: return justOp("moreEqualFloat");
+		case Op::AddLocals: return localLocalOp("addLocals", byteCode, offset);
+		case Op::LessLocalConstantJumpIfFalse: return localConstantOp("lessLocalConstantJumpIfFalse", byteCode, offset);
+		case Op::LessEqualLocalConstantJumpIfFalse: return localConstantOp("lessEqualLocalConstantJumpIfFalse", byteCode, offset);
+		case Op::MoreLocalConstantJumpIfFalse: return localConstantOp("moreLocalConstantJumpIfFalse", byteCode, offset);
+		case Op::MoreEqualLocalConstantJumpIfFalse: return localConstantOp("moreEqualLocalConstantJumpIfFalse", byteCode, offset);
+		case Op::AddLocalConstant: return localConstantOp("addLocalConstant", byteCode, offset);
+		case Op::TailCall: return opNumber("tailCall", byteCode, offset);
+		case Op::GetIter: return justOp("getIter");
+		case Op::ForIter: return jump("forIter", byteCode, offset, 1);
+		case Op::ForRangeBegin: return jump("forRangeBegin", byteCode, offset, 1);
+		case Op::ForRange: return jump("forRange", byteCode, offset, 1);
+		case Op::ConcatN: return opNumber("concatN", byteCode, offset);
 	}
 	std::cout << "invalid op";
 	return 1;
 }
 
-void Voxl::disassembleByteCode(const ByteCode& byteCode, const Allocator& allocator)
+void Voxl::disassembleByteCode(const ByteCode& byteCode)
 {
 	size_t offset = 0;
 	while (offset < byteCode.code.size())
 	{
-		offset += disassembleInstruction(byteCode, offset, allocator);
+		offset += disassembleInstruction(byteCode, offset);
 		std::cout << '\n';
 	}
+
+	for (const auto& handler : byteCode.exceptionHandlers)
+	{
+		std::cout
+			<< "handler [" << handler.begin << ", " << handler.end << ") -> " << handler.handlerOffset
+			<< " stack size " << handler.stackSize << '\n';
+	}
 }
\ No newline at end of file
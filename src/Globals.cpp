@@ -0,0 +1,69 @@
+#include <Globals.hpp>
+
+using namespace Voxl;
+
+bool Globals::set(ObjString* name, const Value& value)
+{
+	auto& variable = m_slots[slotIndex(name)];
+	const auto wasDefined = variable.isDefined;
+	variable.value = value;
+	variable.isDefined = true;
+	return wasDefined == false;
+}
+
+std::optional<Value&> Globals::get(const ObjString* name)
+{
+	const auto index = m_slotIndices.get(name);
+	if (index.has_value() == false)
+		return std::nullopt;
+
+	auto& variable = m_slots[index->asInt()];
+	if (variable.isDefined == false)
+		return std::nullopt;
+	return variable.value;
+}
+
+std::optional<Value&> Globals::get(std::string_view name)
+{
+	const auto index = m_slotIndices.get(name);
+	if (index.has_value() == false)
+		return std::nullopt;
+
+	auto& variable = m_slots[index->asInt()];
+	if (variable.isDefined == false)
+		return std::nullopt;
+	return variable.value;
+}
+
+uint32_t Globals::slotIndex(ObjString* name)
+{
+	if (const auto index = findSlotIndex(name); index.has_value())
+		return *index;
+
+	const auto index = static_cast<uint32_t>(m_slots.size());
+	m_slots.push_back(Slot{ name, Value::null(), false, NO_SLOT });
+	m_slotIndices.set(name, Value(static_cast<Int>(index)));
+	return index;
+}
+
+std::optional<uint32_t> Globals::findSlotIndex(const ObjString* name)
+{
+	const auto index = m_slotIndices.get(name);
+	if (index.has_value() == false)
+		return std::nullopt;
+	return static_cast<uint32_t>(index->asInt());
+}
+
+std::vector<Globals::Slot>& Globals::slots()
+{
+	return m_slots;
+}
+
+void Globals::clear()
+{
+	for (auto& variable : m_slots)
+	{
+		variable.value = Value::null();
+		variable.isDefined = false;
+	}
+}
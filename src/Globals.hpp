@@ -0,0 +1,50 @@
+#pragma once
+
+#include <HashTable.hpp>
+#include <vector>
+
+namespace Voxl
+{
+
+// Stores the global variables of a module in slots so the vm can access them by index instead of hashing the name on 
+// every access. The compiler resolves the names to slot indices so a slot can exist before the variable is defined.
+// Slot indices never change, undefining a variable (clear) only marks the slot as undefined so compiled code stays valid.
+class Globals
+{
+public:
+	static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+	struct Slot
+	{
+		ObjString* name;
+		Value value;
+		bool isDefined;
+		// Index of the slot with the same name in the builtins. Cached on the first access of an undefined global.
+		uint32_t builtinSlotIndex;
+	};
+
+public:
+	// Returns true if the variable wasn't defined before.
+	bool set(ObjString* name, const Value& value);
+	std::optional<Value&> get(const ObjString* name);
+	std::optional<Value&> get(std::string_view name);
+	// Creates an undefined slot if the name doesn't have one.
+	uint32_t slotIndex(ObjString* name);
+	std::optional<uint32_t> findSlotIndex(const ObjString* name);
+	Slot& slot(uint32_t index);
+	std::vector<Slot>& slots();
+	void clear();
+
+private:
+	// Name -> Int slot index.
+	HashTable m_slotIndices;
+	std::vector<Slot> m_slots;
+};
+
+inline Globals::Slot& Globals::slot(uint32_t index)
+{
+	ASSERT(index < m_slots.size());
+	return m_slots[index];
+}
+
+}
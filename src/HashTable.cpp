@@ -152,6 +152,11 @@ HashTable::ConstIterator HashTable::cend() const
 	return ConstIterator(*this, m_data + m_capacity);
 }
 
+size_t HashTable::size() const
+{
+	return m_size;
+}
+
 size_t HashTable::capacity() const
 {
 	return m_capacity;
@@ -60,6 +60,7 @@ public:
 	std::optional<Value&> get(std::string_view key);
 	
 	void print();
+	size_t size() const;
 	size_t capacity() const;
 	Bucket* data();
 	void clear();
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <HashTable.hpp>
+#include <Globals.hpp>
 #include <ByteCode.hpp>
 
 namespace Voxl
@@ -8,6 +8,8 @@ namespace Voxl
 
 #define OBJ_TYPE_LIST(macro) \
 	macro(String) \
+	macro(Rope) \
+	macro(Int) \
 	macro(Function) \
 	macro(Closure) \
 	macro(Upvalue) \
@@ -16,7 +18,8 @@ namespace Voxl
 	macro(Class) \
 	macro(Instance) \
 	macro(BoundFunction) \
-	macro(Module)
+	macro(Module) \
+	macro(Shape)
 
 enum class ObjType
 {
@@ -61,6 +64,8 @@ struct Obj
 		case ObjType::Function:	return true;
 		case ObjType::NativeFunction: return true;
 		case ObjType::String: return false;
+		case ObjType::Rope: return false;
+		case ObjType::Int: return false;
 		case ObjType::Closure: return false;
 		case ObjType::Upvalue: return false;
 		case ObjType::NativeInstance: return false;
@@ -68,6 +73,7 @@ struct Obj
 		case ObjType::Instance: return false;
 		case ObjType::BoundFunction: return false;
 		case ObjType::Module: return false;
+		case ObjType::Shape: return false;
 		}
 		return false;
 	}
@@ -101,13 +107,68 @@ struct ObjString : public Obj
 	}
 };
 
+// A concatenation of two strings that hasn't been flattened yet. Repeated concatenation only allocates a node each time
+// and the characters are copied once, when they are first needed. Ropes have the class String.
+struct ObjRope : public Obj
+{
+	// ObjString or ObjRope. Set to nullptr after flattening so the pieces can be freed.
+	Obj* left;
+	Obj* right;
+	size_t size;
+	// nullptr until the rope is flattened.
+	ObjString* flattened;
+
+	// Shorter concatenations are allocated as strings.
+	static constexpr size_t MIN_SIZE = 64;
+
+	// The string has to be an ObjString or an ObjRope.
+	static size_t stringSize(const Obj* string)
+	{
+		return string->isString() ? string->asString()->size : string->asRope()->size;
+	}
+
+	// Calls function with the characters of the pieces of the string in order. Doesn't recurse, because ropes built
+	// in a loop are as deep as the number of iterations.
+	template<typename Function>
+	static void forEachPiece(const Obj* string, Function function)
+	{
+		std::vector<const Obj*> stack{ string };
+		while (stack.empty() == false)
+		{
+			const auto obj = stack.back();
+			stack.pop_back();
+			if (obj->isString())
+			{
+				const auto piece = obj->asString();
+				function(std::string_view(piece->chars, piece->size));
+				continue;
+			}
+
+			const auto rope = obj->asRope();
+			if (rope->flattened != nullptr)
+			{
+				stack.push_back(rope->flattened);
+				continue;
+			}
+			stack.push_back(rope->right);
+			stack.push_back(rope->left);
+		}
+	}
+};
+
+// An int that doesn't fit into a NaN boxed value. Only allocated with VOXL_NAN_BOXING.
+struct ObjInt : public Obj
+{
+	Int value;
+};
+
 struct ObjFunction : public Obj
 {
 	ObjString* name;
 	int argCount;
 	ByteCode byteCode;
 	int upvalueCount;
-	HashTable* globals;
+	Globals* globals;
 };
 
 class Context;
@@ -127,16 +188,58 @@ struct ObjNativeFunction : public Obj
 	ObjString* name;
 	int argCount;
 	NativeFunction function;
-	HashTable* globals;
+	Globals* globals;
 	void* context;
 };
 
+// Methods called by the vm to implement operators.
+enum class SpecialMethod
+{
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	Lt,
+	Le,
+	Gt,
+	Ge,
+	GetIndex,
+	SetIndex,
+	Eq,
+	Str,
+	Count
+};
+
 struct ObjClass : public Obj
 {
+	static constexpr size_t SPECIAL_METHOD_COUNT = static_cast<size_t>(SpecialMethod::Count);
+	// specialMethodsVersion of classes whose special methods were never resolved.
+	static constexpr size_t SPECIAL_METHODS_NOT_RESOLVED = SIZE_MAX;
+
 	ObjString* name;
 	HashTable fields;
+	// The fields of the class merged with the fields it inherits, so lookups don't have to walk the superclasses.
+	// Updated when the class or any of its superclasses is modified.
+	HashTable resolvedFields;
 	size_t instanceSize;
 	std::optional<ObjClass&> superclass;
+	// Used to update the resolved fields of the subclasses. The references are weak, subclasses that are freed are
+	// removed by the garbage collector.
+	std::vector<ObjClass*> subclasses;
+	// Incremented every time the resolved fields change, which happens when a field of the class or of a superclass
+	// that the class doesn't override is set. Used to invalidate inline caches.
+	size_t version;
+	// The superclasses ordered from the root of the hierarchy followed by the class itself. A class is at index
+	// depth in the display of all of its subclasses, so checking if a class is a subclass doesn't require walking
+	// the superclasses.
+	std::vector<ObjClass*> display;
+	// The special methods found in the fields of the class or its superclasses, so operators don't have to look them
+	// up. Null if the method isn't defined. They are resolved again when the version of the class changes.
+	Value specialMethods[SPECIAL_METHOD_COUNT];
+	size_t specialMethodsVersion;
+	// Shape of instances without any fields. Allocated when the first instance is created.
+	ObjShape* emptyShape;
 	MarkingFunctionPtr mark;
 
 	// This is called before $init so the object is in a valid state when entering $init. The user might try to allocate
@@ -163,12 +266,46 @@ struct ObjClass : public Obj
 	{
 		return instanceSize != 0;
 	}
+
+	// Returns true if the class is other or inherits from it.
+	bool isSubclassOf(const ObjClass& other) const
+	{
+		const auto depth = other.display.size() - 1;
+		return (depth < display.size()) && (display[depth] == &other);
+	}
+};
+
+// Instances that had the same fields added in the same order share a shape. The shape maps field names to slot indices
+// so the instances only need to store the values.
+struct ObjShape : public Obj
+{
+	// After reaching any of these limits instances switch to dictionary mode instead of creating new shapes.
+	static constexpr size_t MAX_FIELD_COUNT = 64;
+	static constexpr size_t MAX_TRANSITION_COUNT = 32;
+
+	// Field name -> slot index.
+	HashTable fieldIndices;
+	// Field name -> shape with that field added.
+	HashTable transitions;
+	size_t fieldCount;
 };
 
 struct ObjInstance : public Obj
 {
+	static constexpr size_t INLINE_SLOT_COUNT = 4;
+
 	ObjClass* class_;
-	HashTable fields;
+	// nullptr if the instance is in dictionary mode. In dictionary mode the fields are stored in fields instead of slots.
+	ObjShape* shape;
+	union
+	{
+		// Points to inlineSlots until the instance has more fields than fit inline.
+		Value* slots;
+		// Allocated when the instance switches to dictionary mode, which few instances do.
+		HashTable* fields;
+	};
+	size_t slotCapacity;
+	Value inlineSlots[INLINE_SLOT_COUNT];
 };
 
 // Native classes could be implemented using virtual inheritance, but then they would need to store more data 
@@ -193,6 +330,8 @@ struct ObjUpvalue : public Obj
 {
 	Value value;
 	Value* location;
+	// The next open upvalue lower on the stack. Only used while the upvalue is open.
+	ObjUpvalue* next;
 };
 
 struct ObjClosure : public Obj
@@ -204,7 +343,7 @@ struct ObjClosure : public Obj
 
 struct ObjModule : public Obj
 {
-	HashTable globals;
+	Globals globals;
 	bool isLoaded;
 };
 
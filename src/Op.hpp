@@ -35,13 +35,13 @@ namespace Voxl
 		GetConstant, // index
 		GetLocal, // index
 		SetLocal, // index [rhs]
-		CreateGlobal, // [initializer, name]
-		GetGlobal, // [name]
-		SetGlobal, // [rhs, name]
+		CreateGlobal, // slot [initializer]
+		GetGlobal, // slot
+		SetGlobal, // slot [rhs]
 		GetUpvalue, // index
 		SetUpvalue, // index [rhs]
-		GetField, // [value name] -> [field]
-		SetField, // [rhs instance name]
+		GetField, // cacheIndex [value name] -> [field]
+		SetField, // cacheIndex [rhs instance name]
 		StoreMethod, // [class function name]
 		GetIndex, // [value, index]
 		SetIndex, // [value, index, rhs]
@@ -73,8 +73,6 @@ namespace Voxl
 
 		Call, // argCount [function, args...]
 		Return,
-		TryBegin, // absolute jump to catch stmt.
-		TryEnd,
 		FinallyBegin,
 		FinallyEnd,
 		Throw, // [value]
@@ -90,5 +88,60 @@ namespace Voxl
 		ExpressionStatementBegin, // [] -> []
 		ExpressionStatementReturn,
 		Inherit, // [class, superclass] -> [class]
+		Invoke, // cacheIndex nameConstant argCount [receiver, arguments...] -> [result]
+
+		// Quickened versions of the binary ops. The vm replaces the generic op with one of these after executing it
+		// on operands of the matching type and replaces it back if the types don't match.
+		// [lhs, rhs] -> [result]
+		// {
+		AddInt,
+		AddFloat,
+		SubtractInt,
+		SubtractFloat,
+		MultiplyInt,
+		MultiplyFloat,
+		LessInt,
+		LessFloat,
+		LessEqualInt,
+		LessEqualFloat,
+		MoreInt,
+		MoreFloat,
+		MoreEqualInt,
+		MoreEqualFloat,
+		// }
+
+		// Superinstructions emitted by the compiler for common sequences of ops. They only handle numbers and if the
+		// operands have other types they do what the first ops of the sequence would and continue with the rest of the
+		// sequence, which is always emitted after them.
+		AddLocals, // localA localB -> [result] - GetLocal GetLocal Add
+		// local constant - GetLocal GetConstant Less, always followed by JumpIfFalseAndPop.
+		// {
+		LessLocalConstantJumpIfFalse,
+		LessEqualLocalConstantJumpIfFalse,
+		MoreLocalConstantJumpIfFalse,
+		MoreEqualLocalConstantJumpIfFalse,
+		// }
+		AddLocalConstant, // local constant - GetLocal GetConstant Add, always followed by SetLocal local and PopStack.
+
+		// argCount [function, args...], always followed by Return. Reuses the current call frame if the function is
+		// a voxl function, otherwise works like Call.
+		TailCall,
+
+		// Used by for loops. Lists and dicts are iterated by the vm, other values use $iter() and $next().
+		GetIter, // [iterable] -> [iterator]
+		// jump [iterator, index] -> [iterator, index, item], jumps forward when the iterator is exhausted.
+		// The end of a $next() iterator is signaled by throwing StopIteration, which is caught by the exception
+		// handler covering this instruction.
+		ForIter,
+		// Counted loops used by for loops over Range(start, end). The counter is stored in the index slot and the end in
+		// the iterator slot so no range is created.
+		// jump [Range, start, end] -> [end, start] and jumps forward over the code that calls Range and executes
+		// GetIter. If the calle isn't the builtin Range or the arguments aren't ints it does nothing.
+		ForRangeBegin,
+		// jump [end, counter] -> [end, counter, item] the same as ForIter. Executes ForIter if the iterator isn't an int.
+		ForRange,
+
+		// count [parts...] -> [string] - a chain of count - 1 Concats. The parts are formatted into a single string.
+		ConcatN,
 	};
 }
\ No newline at end of file
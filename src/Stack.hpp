@@ -0,0 +1,300 @@
+#pragma once
+
+#include <Asserts.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+
+// Stack that starts small and only grows when grow() is called, never by itself, so pointers into the stack stay valid
+// until then. After growing the user has to update the pointers it stores using the old data pointer.
+template<typename T, size_t MAX_SIZE>
+class Stack
+{
+	// The items are moved using memcpy.
+	static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+	struct ConstReverseIterator
+	{
+		ConstReverseIterator& operator++();
+		const T& operator*() const;
+		const T* operator->();
+		bool operator==(const ConstReverseIterator& other) const;
+		bool operator!=(const ConstReverseIterator& other) const;
+
+		const T* ptr;
+	};
+
+public:
+	Stack();
+	~Stack();
+	Stack(const Stack&) = delete;
+	Stack& operator=(const Stack&) = delete;
+
+	[[nodiscard]] bool push(const T& value);
+	[[nodiscard]] bool push();
+	void pop();
+	void popN(size_t n);
+	T popAndReturn();
+	T& peek(size_t i);
+	T& top();
+	const T& top() const;
+	T& operator[](size_t i);
+	const T& operator[](size_t i) const;
+	bool isEmpty() const;
+
+	// Makes space for at least freeSpace more items. Returns false if it would exceed MAX_SIZE.
+	[[nodiscard]] bool grow(size_t freeSpace);
+	bool hasSpaceFor(size_t count) const;
+
+	T* data();
+	const T* data() const;
+	size_t size() const;
+	size_t capacity() const;
+	size_t maxSize() const;
+	T* begin();
+	T* end();
+	const T* cbegin() const;
+	const T* cend() const;
+	ConstReverseIterator crbegin() const;
+	ConstReverseIterator crend() const;
+	void clear();
+
+public:
+	T* topPtr;
+private:
+	static constexpr size_t INITIAL_CAPACITY = 16;
+
+	T* m_data;
+	T* m_end;
+};
+
+template<typename T, size_t MAX_SIZE>
+Stack<T, MAX_SIZE>::Stack()
+	: m_data(reinterpret_cast<T*>(::operator new(sizeof(T) * INITIAL_CAPACITY)))
+{
+	topPtr = m_data;
+	m_end = m_data + INITIAL_CAPACITY;
+}
+
+template<typename T, size_t MAX_SIZE>
+Stack<T, MAX_SIZE>::~Stack()
+{
+	::operator delete(m_data);
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::push(const T& value)
+{
+	if (topPtr >= m_end)
+	{
+		return false;
+	}
+	*topPtr = value;
+	topPtr++;
+	return true;
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::push()
+{
+	if (topPtr >= m_end)
+	{
+		return false;
+	}
+	topPtr++;
+	return true;
+}
+
+template<typename T, size_t MAX_SIZE>
+void Stack<T, MAX_SIZE>::pop()
+{
+	ASSERT(topPtr != data());
+	topPtr--;
+}
+
+template<typename T, size_t MAX_SIZE>
+void Stack<T, MAX_SIZE>::popN(size_t n)
+{
+	topPtr -= n;
+	ASSERT(topPtr >= data());
+}
+
+template<typename T, size_t MAX_SIZE>
+T Stack<T, MAX_SIZE>::popAndReturn()
+{
+	ASSERT(topPtr != data());
+	topPtr--;
+	return *topPtr;
+}
+
+template<typename T, size_t MAX_SIZE>
+T& Stack<T, MAX_SIZE>::peek(size_t i)
+{
+	return *(topPtr - 1 - i);
+}
+
+template<typename T, size_t MAX_SIZE>
+T& Stack<T, MAX_SIZE>::top()
+{
+	ASSERT(size() > 0);
+	return *(topPtr - 1);
+}
+
+template<typename T, size_t MAX_SIZE>
+const T& Stack<T, MAX_SIZE>::top() const
+{
+	return *(topPtr - 1);
+}
+
+template<typename T, size_t MAX_SIZE>
+T& Stack<T, MAX_SIZE>::operator[](size_t i)
+{
+	return data()[i];
+}
+
+template<typename T, size_t MAX_SIZE>
+const T& Stack<T, MAX_SIZE>::operator[](size_t i) const
+{
+	return data()[i];
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::isEmpty() const
+{
+	return topPtr == data();
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::grow(size_t freeSpace)
+{
+	const auto requiredCapacity = size() + freeSpace;
+	if (requiredCapacity > MAX_SIZE)
+		return false;
+
+	auto newCapacity = capacity() * 2;
+	while (newCapacity < requiredCapacity)
+		newCapacity *= 2;
+	if (newCapacity > MAX_SIZE)
+		newCapacity = MAX_SIZE;
+
+	const auto oldSize = size();
+	const auto newData = reinterpret_cast<T*>(::operator new(sizeof(T) * newCapacity));
+	memcpy(newData, m_data, sizeof(T) * oldSize);
+	::operator delete(m_data);
+	m_data = newData;
+	m_end = newData + newCapacity;
+	topPtr = newData + oldSize;
+	return true;
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::hasSpaceFor(size_t count) const
+{
+	return static_cast<size_t>(m_end - topPtr) >= count;
+}
+
+template<typename T, size_t MAX_SIZE>
+T* Stack<T, MAX_SIZE>::data()
+{
+	return m_data;
+}
+
+template<typename T, size_t MAX_SIZE>
+const T* Stack<T, MAX_SIZE>::data() const
+{
+	return m_data;
+}
+
+template<typename T, size_t MAX_SIZE>
+inline size_t Stack<T, MAX_SIZE>::size() const
+{
+	return topPtr - data();
+}
+
+template<typename T, size_t MAX_SIZE>
+size_t Stack<T, MAX_SIZE>::capacity() const
+{
+	return m_end - m_data;
+}
+
+template<typename T, size_t MAX_SIZE>
+size_t Stack<T, MAX_SIZE>::maxSize() const
+{
+	return MAX_SIZE;
+}
+
+template<typename T, size_t MAX_SIZE>
+T* Stack<T, MAX_SIZE>::begin()
+{
+	return data();
+}
+
+template<typename T, size_t MAX_SIZE>
+T* Stack<T, MAX_SIZE>::end()
+{
+	return topPtr;
+}
+
+template<typename T, size_t MAX_SIZE>
+const T* Stack<T, MAX_SIZE>::cbegin() const
+{
+	return data();
+}
+
+template<typename T, size_t MAX_SIZE>
+const T* Stack<T, MAX_SIZE>::cend() const
+{
+	return topPtr;
+}
+
+template<typename T, size_t MAX_SIZE>
+typename Stack<T, MAX_SIZE>::ConstReverseIterator Stack<T, MAX_SIZE>::crbegin() const
+{
+	return ConstReverseIterator{ topPtr - 1 };
+}
+
+template<typename T, size_t MAX_SIZE>
+typename Stack<T, MAX_SIZE>::ConstReverseIterator Stack<T, MAX_SIZE>::crend() const
+{
+	return ConstReverseIterator{ data() - 1 };
+}
+
+template<typename T, size_t MAX_SIZE>
+void Stack<T, MAX_SIZE>::clear()
+{
+	topPtr = data();
+}
+
+template<typename T, size_t MAX_SIZE>
+typename Stack<T, MAX_SIZE>::ConstReverseIterator& Stack<T, MAX_SIZE>::ConstReverseIterator::operator++()
+{
+	ptr--;
+	return *this;
+}
+
+template<typename T, size_t MAX_SIZE>
+const T& Stack<T, MAX_SIZE>::ConstReverseIterator::operator*() const
+{
+	return *ptr;
+}
+
+template<typename T, size_t MAX_SIZE>
+const T* Stack<T, MAX_SIZE>::ConstReverseIterator::operator->()
+{
+	return ptr;
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::ConstReverseIterator::operator==(const ConstReverseIterator& other) const
+{
+	return ptr == other.ptr;
+}
+
+template<typename T, size_t MAX_SIZE>
+bool Stack<T, MAX_SIZE>::ConstReverseIterator::operator!=(const ConstReverseIterator& other) const
+{
+	return ptr != other.ptr;
+}
@@ -183,7 +183,7 @@ void TerminalErrorReporter::printStackTrace(const Vm& vm)
 		if (callable->isFunction())
 		{
 			const auto function = callable->asFunction();
-			const auto instructionOffset = frame->instructionPointerBeforeCall - function->byteCode.code.data();
+			const auto instructionOffset = function->byteCode.offsetOf(frame->instructionPointerBeforeCall);
 			const auto lineNumber = (size_t)(instructionOffset) > 100 ? 1 : function->byteCode.lineNumberAtOffset[instructionOffset] + 1;
 			m_out << "line " << lineNumber << " in " << function->name->chars << "()\n";
 		}
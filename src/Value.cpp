@@ -5,37 +5,97 @@
 
 using namespace Voxl;
 
+#ifdef VOXL_NAN_BOXING
+
+static_assert(sizeof(Value) == 8);
+
+Value::Value(Int value)
+	: m_bits(QNAN | TAG_INT | (static_cast<uint64_t>(value) & PAYLOAD_MASK))
+{
+	ASSERT((value >= SMALL_INT_MIN) && (value <= SMALL_INT_MAX));
+}
+
+Value Value::intNum(Int value, Allocator& allocator)
+{
+	if ((value >= SMALL_INT_MIN) && (value <= SMALL_INT_MAX))
+		return Value(value);
+	const auto obj = allocator.allocateInt(value);
+	Value result;
+	result.m_bits = SIGN_BIT | QNAN | TAG_INT | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(obj));
+	return result;
+}
+
+Int Value::bigIntValue() const
+{
+	return bigIntObj()->asInt()->value;
+}
+
+Value::Value(Float value)
+{
+	// Make sure a NaN produced by an operation can't be confused with a boxed value.
+	if (value != value)
+	{
+		m_bits = 0x7ff8000000000000;
+		return;
+	}
+	memcpy(&m_bits, &value, sizeof(value));
+}
+
+Value::Value(Obj* obj)
+	: m_bits(SIGN_BIT | QNAN | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(obj)))
+{}
+
+Value::Value(bool boolean)
+	: m_bits(QNAN | TAG_BOOL | (boolean ? 1 : 0))
+{}
+
+Value Value::null()
+{
+	Value value;
+	value.m_bits = QNAN | TAG_NULL;
+	return value;
+}
+
+#else
+
 Value::Value(Int value)
-	: type(ValueType::Int)
+	: m_type(ValueType::Int)
 {
-	as.intNumber = value;
+	m_as.intNumber = value;
 }
 
 Value::Value(Float value)
-	: type(ValueType::Float)
+	: m_type(ValueType::Float)
 {
-	as.floatNumber = value;
+	m_as.floatNumber = value;
 }
 
 Value::Value(Obj* obj)
-	: type(ValueType::Obj)
+	: m_type(ValueType::Obj)
 {
-	as.obj = obj;
+	m_as.obj = obj;
 }
 
 Value::Value(bool boolean)
-	: type(ValueType::Bool)
+	: m_type(ValueType::Bool)
 {
-	as.boolean = boolean;
+	m_as.boolean = boolean;
 }
 
 Value Value::null()
 {
 	Value value;
-	value.type = ValueType::Null;
+	value.m_type = ValueType::Null;
 	return value;
 }
 
+Value Value::intNum(Int value, Allocator&)
+{
+	return Value(value);
+}
+
+#endif
+
 Value Value::intNum(Int value)
 {
 	return Value(value);
@@ -50,14 +110,14 @@ std::ostream& operator<<(std::ostream& os, const Value value)
 {
 	using namespace Voxl;
 
-	switch (value.type)
+	switch (value.type())
 	{
 		case ValueType::Int:
-			os << value.as.intNumber;
+			os << value.asInt();
 			break;
 
 		case ValueType::Float:
-			os << value.as.floatNumber;
+			os << value.asFloat();
 			break;
 
 		case ValueType::Null:
@@ -65,11 +125,11 @@ std::ostream& operator<<(std::ostream& os, const Value value)
 			break;
 
 		case ValueType::Bool:
-			os << (value.as.boolean ? "true" : "false");
+			os << (value.asBool() ? "true" : "false");
 			break;
 
 		case ValueType::Obj:
-			os << value.as.obj;
+			os << value.asObj();
 			break;
 
 	default:
@@ -89,6 +149,18 @@ std::ostream& operator<< (std::ostream& os, Voxl::Obj* obj)
 			break;
 		}
 
+		case ObjType::Int:
+		{
+			os << obj->asInt()->value;
+			break;
+		}
+
+		case ObjType::Rope:
+		{
+			ObjRope::forEachPiece(obj, [&os](std::string_view piece) { os << piece; });
+			break;
+		}
+
 		case ObjType::Function:
 		{
 			const auto function = obj->asFunction();
@@ -141,6 +213,12 @@ std::ostream& operator<< (std::ostream& os, Voxl::Obj* obj)
 			break;
 		}
 
+		case ObjType::Shape:
+		{
+			os << "<shape>";
+			break;
+		}
+
 		default:
 			ASSERT_NOT_REACHED();
 	}
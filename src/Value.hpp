@@ -2,6 +2,8 @@
 
 #include <Asserts.hpp>
 #include <ostream>
+#include <stdint.h>
+#include <string.h>
 
 namespace Voxl
 {
@@ -10,6 +12,7 @@ using Int = int64_t;
 using Float = double;
 
 struct Obj;
+class Allocator;
 
 #define VALUE_TYPE_LIST(macro) \
 	macro(Int) \
@@ -25,6 +28,11 @@ enum class ValueType
 #undef COMMA
 };
 
+// With VOXL_NAN_BOXING a value is stored in 8 bytes. Floats are stored as is and every other type is encoded inside
+// the unused bits of quiet NaNs. Ints only get 48 bits so any int outside that range is stored in an ObjInt. The pointer
+// to it is tagged as an int, so the value is still an int and not an object. Value(Int) never allocates, so ints that
+// might be outside the range have to be created with intNum(value, allocator).
+// https://craftinginterpreters.com/optimization.html#nan-boxing
 class Value
 {
 public:
@@ -33,51 +41,153 @@ public:
 	explicit Value(Float value);
 	explicit Value(Obj* obj);
 	explicit Value(bool boolean);
-		
+
+#ifdef VOXL_NAN_BOXING
+	static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+	static constexpr uint64_t QNAN = 0x7ffc000000000000;
+	static constexpr uint64_t TAG_MASK = 0x0003000000000000;
+	static constexpr uint64_t TAG_NULL = 0x0001000000000000;
+	static constexpr uint64_t TAG_BOOL = 0x0002000000000000;
+	static constexpr uint64_t TAG_INT = 0x0003000000000000;
+	static constexpr uint64_t PAYLOAD_MASK = 0x0000ffffffffffff;
+	static constexpr Int SMALL_INT_MIN = -(static_cast<Int>(1) << 47);
+	static constexpr Int SMALL_INT_MAX = (static_cast<Int>(1) << 47) - 1;
+
+	bool isFloat() const
+	{
+		return (m_bits & QNAN) != QNAN;
+	}
+
+	bool isObj() const
+	{
+		return (m_bits & (SIGN_BIT | QNAN | TAG_MASK)) == (SIGN_BIT | QNAN);
+	}
+
+	// Small ints have the sign bit cleared and big ints have it set.
+	bool isInt() const
+	{
+		return (m_bits & (QNAN | TAG_MASK)) == (QNAN | TAG_INT);
+	}
+
+	bool isBigInt() const
+	{
+		return (m_bits & (SIGN_BIT | QNAN | TAG_MASK)) == (SIGN_BIT | QNAN | TAG_INT);
+	}
+
+	// The ObjInt storing a big int. Only used to mark it.
+	Obj* bigIntObj() const
+	{
+		ASSERT(isBigInt());
+		return reinterpret_cast<Obj*>(static_cast<uintptr_t>(m_bits & PAYLOAD_MASK));
+	}
+
+	bool isNull() const
+	{
+		return m_bits == (QNAN | TAG_NULL);
+	}
+
+	bool isBool() const
+	{
+		return (m_bits & ~static_cast<uint64_t>(1)) == (QNAN | TAG_BOOL);
+	}
+
+	ValueType type() const
+	{
+		if (isFloat())
+			return ValueType::Float;
+		if (isObj())
+			return ValueType::Obj;
+		switch (m_bits & TAG_MASK)
+		{
+		case TAG_NULL: return ValueType::Null;
+		case TAG_BOOL: return ValueType::Bool;
+		default: return ValueType::Int;
+		}
+	}
+
+	const Int asInt() const
+	{
+		ASSERT(isInt());
+		if ((m_bits & SIGN_BIT) != 0)
+			return bigIntValue();
+		// Sign extend the 48 bit payload.
+		return static_cast<Int>(m_bits << 16) >> 16;
+	}
+
+	const Float asFloat() const
+	{
+		ASSERT(isFloat());
+		Float value;
+		memcpy(&value, &m_bits, sizeof(value));
+		return value;
+	}
+
+	Obj* asObj() const
+	{
+		ASSERT(isObj());
+		return reinterpret_cast<Obj*>(static_cast<uintptr_t>(m_bits & PAYLOAD_MASK));
+	}
+
+	bool asBool() const
+	{
+		ASSERT(isBool());
+		return (m_bits & 1) != 0;
+	}
+#else
 #define GENERATE_HELPERS(valueType) \
 	bool is##valueType() const \
 	{ \
-		return type == ValueType::valueType; \
+		return m_type == ValueType::valueType; \
 	}
 	VALUE_TYPE_LIST(GENERATE_HELPERS)
 #undef GENERATE_HELPERS
 
+	ValueType type() const
+	{
+		return m_type;
+	}
+
 	const Int asInt() const
 	{
 		ASSERT(isInt());
-		return as.intNumber;
+		return m_as.intNumber;
 	}
 
 	const Float asFloat() const
 	{
 		ASSERT(isFloat());
-		return as.floatNumber;
-	}
-
-	Obj* asObj()
-	{
-		ASSERT(isObj());
-		return as.obj;
+		return m_as.floatNumber;
 	}
 
-	const Obj* asObj() const
+	Obj* asObj() const
 	{
 		ASSERT(isObj());
-		return as.obj;
+		return m_as.obj;
 	}
 
 	bool asBool() const
 	{
 		ASSERT(isBool());
-		return as.boolean;
+		return m_as.boolean;
 	}
+#endif
 
 public:
 	static Value null();
 	static Value intNum(Int value);
+	// Allocates an ObjInt if NaN boxing is enabled and the value doesn't fit into 48 bits, so it may run the garbage
+	// collector.
+	static Value intNum(Int value, Allocator& allocator);
 	static Value floatNum(Float value);
 
-	ValueType type;
+private:
+#ifdef VOXL_NAN_BOXING
+	// Defined out of line, because ObjInt isn't complete here.
+	Int bigIntValue() const;
+
+	uint64_t m_bits;
+#else
+	ValueType m_type;
 
 	union
 	{
@@ -85,7 +195,8 @@ public:
 		Float floatNumber;
 		Obj* obj;
 		bool boolean;
-	} as;
+	} m_as;
+#endif
 };
 
 }
@@ -4,6 +4,13 @@
 
 using namespace Voxl;
 
+LocalValue Dict::iter(Context& c)
+{
+	// For loops iterate dicts directly. This is only used when $iter() is called explicitly.
+	LocalValue iteratorType(Value(c.vm.m_dictIteratorType), c);
+	return iteratorType(c.args(0));
+}
+
 LocalValue Dict::get_index(Context& c)
 {
 	auto self = c.args(0).asObj<Dict>();
@@ -48,6 +55,24 @@ LocalValue Dict::get_size(Context& c)
 	return LocalValue::intNum(static_cast<Int>(self->size), c);
 }
 
+const Value* Dict::nextKey(Int& position) const
+{
+	static constexpr Int INDEX_MASK = (Int(1) << POSITION_BUCKET_LIST_SHIFT) - 1;
+	auto listIndex = static_cast<size_t>(position >> POSITION_BUCKET_LIST_SHIFT);
+	auto indexInList = static_cast<size_t>(position & INDEX_MASK);
+	for (; listIndex < bucketLists.size(); listIndex++, indexInList = 0)
+	{
+		const auto& list = bucketLists[listIndex];
+		if (indexInList < list.size())
+		{
+			position = (static_cast<Int>(listIndex) << POSITION_BUCKET_LIST_SHIFT) | static_cast<Int>(indexInList + 1);
+			// Linear in the index inside the list, which is small as long as the load factor is.
+			return &std::next(list.begin(), indexInList)->key;
+		}
+	}
+	return nullptr;
+}
+
 void Dict::init(Dict* self)
 {
 	new (&self->bucketLists) Buckets();
@@ -75,7 +100,7 @@ void Dict::mark(Dict* self, Allocator& allocator)
 std::pair<std::list<Dict::Bucket>&, std::optional<Dict::Bucket&>> Dict::findBucket(Context& c, LocalValue& key)
 {
 	auto hashValue = key.get("$hash")();
-	if (hashValue.asInt() == false)
+	if (hashValue.isInt() == false)
 	{
 		auto typeError = c.get("TypeError");
 		throw NativeException(typeError(LocalValue("$hash() has to return an 'Int'", c)));
@@ -84,6 +109,7 @@ std::pair<std::list<Dict::Bucket>&, std::optional<Dict::Bucket&>> Dict::findBuck
 	auto& buckets = bucketLists[hash];
 	for (auto& bucket : buckets)
 	{
+		Allocator::HandleScope handleScope(c.allocator);
 		if (key == LocalValue(bucket.key, c))
 		{
 			return { buckets, bucket };
@@ -91,3 +117,35 @@ std::pair<std::list<Dict::Bucket>&, std::optional<Dict::Bucket&>> Dict::findBuck
 	}
 	return { buckets, std::nullopt };
 }
+
+LocalValue DictIterator::init(Context& c)
+{
+	auto iterator = c.args(0).asObj<DictIterator>();
+	auto dict = c.args(1).asObj<Dict>();
+	iterator->dict = dict.obj;
+	return LocalValue::null(c);
+}
+
+LocalValue DictIterator::next(Context& c)
+{
+	auto iterator = c.args(0).asObj<DictIterator>();
+	const auto key = iterator->dict->nextKey(iterator->position);
+	if (key == nullptr)
+	{
+		auto stopIterationType = c.get("StopIteration");
+		throw NativeException(stopIterationType());
+	}
+	return LocalValue(*key, c);
+}
+
+void DictIterator::construct(DictIterator* iterator)
+{
+	iterator->dict = nullptr;
+	iterator->position = 0;
+}
+
+void DictIterator::mark(DictIterator* iterator, Allocator& allocator)
+{
+	if (iterator->dict != nullptr)
+		allocator.addObj(iterator->dict);
+}
@@ -8,6 +8,8 @@ namespace Voxl
 
 struct Dict : public ObjNativeInstance
 {
+	static constexpr int iterArgCount = 1;
+	static LocalValue iter(Context& c);
 	static constexpr int getIndexArgCount = 2;
 	static LocalValue get_index(Context& c);
 	static constexpr int setIndexArgCount = 3;
@@ -28,9 +30,30 @@ struct Dict : public ObjNativeInstance
 	static constexpr float MAX_LOAD_FACTOR = 0.75f;
 
 	std::pair<std::list<Bucket>&, std::optional<Bucket&>> findBucket(Context& c, LocalValue& key);
+	// Returns the key at the iteration position and advances the position or returns nullptr if there are no more keys.
+	// The position stores the bucket list index in the upper bits and the index inside the list in the lower bits.
+	// Starts at 0.
+	const Value* nextKey(Int& position) const;
+	static constexpr int POSITION_BUCKET_LIST_SHIFT = 24;
 	using Buckets = std::vector<std::list<Bucket>>;
 	Buckets bucketLists;
 	size_t size;
 };
 
+// Iterates over the keys of a dict.
+struct DictIterator : public ObjNativeInstance
+{
+	static constexpr int initArgCount = 2;
+	static LocalValue init(Context& c);
+	static constexpr int nextArgCount = 1;
+	static LocalValue next(Context& c);
+
+	static void construct(DictIterator* iterator);
+	static void mark(DictIterator* iterator, Allocator& allocator);
+
+	Dict* dict;
+	// The position passed to Dict::nextKey().
+	Int position;
+};
+
 }
\ No newline at end of file
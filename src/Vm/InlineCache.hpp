@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Value.hpp>
+
+#include <stdint.h>
+
+namespace Voxl
+{
+
+struct ObjShape;
+struct ObjClass;
+
+struct InlineCacheEntry
+{
+	enum class Kind : uint8_t
+	{
+		// The field is stored in an instance slot.
+		Slot,
+		// The field is a method that has to be bound.
+		Method,
+		// The field doesn't exist and assigning it changes the shape to newShape.
+		Transition,
+	};
+
+	// ObjShape* for instances and ObjClass* for everything else.
+	const void* key;
+	Kind kind;
+	uint32_t slot;
+	Value method;
+	ObjShape* newShape;
+	// The class of the receiver and its version when a method entry was added. The entry is outdated after the class or
+	// any of its superclasses is modified.
+	const ObjClass* class_;
+	size_t classVersion;
+};
+
+// Caches the result of field accesses performed by a single instruction.
+struct InlineCache
+{
+	static constexpr size_t MAX_ENTRY_COUNT = 4;
+
+	const InlineCacheEntry* find(const void* key) const
+	{
+		for (size_t i = 0; i < entryCount; i++)
+		{
+			if (entries[i].key == key)
+				return &entries[i];
+		}
+		return nullptr;
+	}
+
+	// Replaces the entry with the same key if there is one. After the cache is full it stops caching new entries.
+	void add(const InlineCacheEntry& entry)
+	{
+		for (size_t i = 0; i < entryCount; i++)
+		{
+			if (entries[i].key == entry.key)
+			{
+				entries[i] = entry;
+				return;
+			}
+		}
+		if (entryCount < MAX_ENTRY_COUNT)
+		{
+			entries[entryCount] = entry;
+			entryCount++;
+		}
+	}
+
+	void clear()
+	{
+		entryCount = 0;
+	}
+
+	InlineCacheEntry entries[MAX_ENTRY_COUNT];
+	size_t entryCount = 0;
+	size_t hits = 0;
+	size_t misses = 0;
+};
+
+}
@@ -7,7 +7,8 @@ using namespace Voxl;
 
 LocalValue List::iter(Context& c)
 {
-	auto iteratorType = c.get("_ListIterator");
+	// For loops iterate lists directly. This is only used when $iter() is called explicitly.
+	LocalValue iteratorType(Value(c.vm.m_listIteratorType), c);
 	return iteratorType(c.args(0));
 }
 
@@ -107,5 +108,5 @@ void ListIterator::mark(ListIterator* iterator, Allocator& allocator)
 {
 	if (iterator->list == nullptr)
 		return;
-	allocator.addObj(reinterpret_cast<Obj*>(iterator));
+	allocator.addObj(iterator->list);
 }
@@ -0,0 +1,74 @@
+#include <Vm/Range.hpp>
+#include <Vm/Vm.hpp>
+#include <Allocator.hpp>
+#include <Context.hpp>
+
+using namespace Voxl;
+
+LocalValue Range::init(Context& c)
+{
+	auto range = c.args(0).asObj<Range>();
+	auto start = c.args(1);
+	auto end = c.args(2);
+	if ((start.isInt() == false) || (end.isInt() == false))
+	{
+		auto typeError = c.get("TypeError");
+		throw NativeException(typeError(LocalValue("Range() arguments have to be of type 'Int'", c)));
+	}
+	range->start = start.asInt();
+	range->end = end.asInt();
+	return LocalValue::null(c);
+}
+
+LocalValue Range::iter(Context& c)
+{
+	// For loops iterate ranges directly. This is only used when $iter() is called explicitly.
+	LocalValue iteratorType(Value(c.vm.m_rangeIteratorType), c);
+	return iteratorType(c.args(0));
+}
+
+LocalValue Range::get_size(Context& c)
+{
+	auto range = c.args(0).asObj<Range>();
+	return LocalValue::intNum((range->end > range->start) ? (range->end - range->start) : 0, c);
+}
+
+void Range::construct(Range* range)
+{
+	range->start = 0;
+	range->end = 0;
+}
+
+void Range::mark(Range*, Allocator&)
+{}
+
+LocalValue RangeIterator::init(Context& c)
+{
+	auto iterator = c.args(0).asObj<RangeIterator>();
+	auto range = c.args(1).asObj<Range>();
+	iterator->current = range->start;
+	iterator->end = range->end;
+	return LocalValue::null(c);
+}
+
+LocalValue RangeIterator::next(Context& c)
+{
+	auto iterator = c.args(0).asObj<RangeIterator>();
+	if (iterator->current >= iterator->end)
+	{
+		auto stopIterationType = c.get("StopIteration");
+		throw NativeException(stopIterationType());
+	}
+	const auto result = iterator->current;
+	iterator->current++;
+	return LocalValue::intNum(result, c);
+}
+
+void RangeIterator::construct(RangeIterator* iterator)
+{
+	iterator->current = 0;
+	iterator->end = 0;
+}
+
+void RangeIterator::mark(RangeIterator*, Allocator&)
+{}
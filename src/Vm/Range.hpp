@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Value.hpp>
+#include <Allocator.hpp>
+
+namespace Voxl
+{
+
+// The ints in [start, end). The values are computed when iterating. For loops over Range(start, end) are compiled into
+// counted loops that don't create the range.
+struct Range : public ObjNativeInstance
+{
+	static constexpr int initArgCount = 3;
+	static LocalValue init(Context& c);
+	static constexpr int iterArgCount = 1;
+	static LocalValue iter(Context& c);
+	static constexpr int getSizeArgCount = 1;
+	static LocalValue get_size(Context& c);
+
+	static void construct(Range* range);
+	static void mark(Range* range, Allocator& allocator);
+
+	Int start;
+	Int end;
+};
+
+struct RangeIterator : public ObjNativeInstance
+{
+	static constexpr int initArgCount = 2;
+	static LocalValue init(Context& c);
+	static constexpr int nextArgCount = 1;
+	static LocalValue next(Context& c);
+
+	static void construct(RangeIterator* iterator);
+	static void mark(RangeIterator* iterator, Allocator& allocator);
+
+	Int current;
+	Int end;
+};
+
+}
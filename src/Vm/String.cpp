@@ -12,5 +12,10 @@ LocalValue String::len(Context& c)
 LocalValue String::hash(Context& c)
 {
 	const auto string = c.args(0).asString();
+#ifdef VOXL_NAN_BOXING
+	// Keep the hash in the small int range so it doesn't have to be allocated.
+	return LocalValue::intNum(static_cast<Int>(string->hash & static_cast<size_t>(Value::SMALL_INT_MAX)), c);
+#else
 	return LocalValue::intNum(string->hash, c);
+#endif
 }
@@ -0,0 +1,75 @@
+#include <Vm/StringBuilder.hpp>
+#include <Vm/Vm.hpp>
+#include <Context.hpp>
+#include <Utf8.hpp>
+#include <sstream>
+
+using namespace Voxl;
+
+LocalValue StringBuilder::append(Context& c)
+{
+	auto self = c.args(0).asObj<StringBuilder>();
+	append(self->chars, self->length, c.args(1).value);
+	return LocalValue::null(c);
+}
+
+LocalValue StringBuilder::append_line(Context& c)
+{
+	auto self = c.args(0).asObj<StringBuilder>();
+	append(self->chars, self->length, c.args(1).value);
+	self->chars += '\n';
+	self->length++;
+	return LocalValue::null(c);
+}
+
+LocalValue StringBuilder::get_size(Context& c)
+{
+	auto self = c.args(0).asObj<StringBuilder>();
+	return LocalValue::intNum(static_cast<Int>(self->length), c);
+}
+
+LocalValue StringBuilder::build(Context& c)
+{
+	auto self = c.args(0).asObj<StringBuilder>();
+	return LocalValue(Value(c.allocator.allocateString(self->chars, self->length)), c);
+}
+
+void StringBuilder::append(std::string& chars, size_t& length, const Value& value)
+{
+	if (value.isObj() && value.asObj()->isString())
+	{
+		const auto string = value.asObj()->asString();
+		chars.append(string->chars, string->size);
+		length += string->length;
+		return;
+	}
+
+	const auto oldSize = chars.size();
+	if (value.isObj() && value.asObj()->isRope())
+	{
+		// Not flattened, because the flattened string would only be used once.
+		ObjRope::forEachPiece(value.asObj(), [&chars](std::string_view piece) { chars += piece; });
+	}
+	else
+	{
+		std::stringstream formatted;
+		formatted << value;
+		chars += formatted.str();
+	}
+	length += Utf8::strlen(chars.data() + oldSize, chars.size() - oldSize);
+}
+
+void StringBuilder::init(StringBuilder* self)
+{
+	new (&self->chars) std::string();
+	self->length = 0;
+}
+
+void StringBuilder::free(StringBuilder* self)
+{
+	using std::string;
+	self->chars.~string();
+}
+
+void StringBuilder::mark(StringBuilder*, Allocator&)
+{}
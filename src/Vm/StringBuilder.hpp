@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Value.hpp>
+#include <Allocator.hpp>
+#include <string>
+
+namespace Voxl
+{
+
+// Accumulates a string in a growable buffer, so appending doesn't allocate a string every time. The UTF-8 length is
+// counted while appending, so build doesn't have to scan the characters again.
+struct StringBuilder : public ObjNativeInstance
+{
+	static constexpr int appendArgCount = 2;
+	static LocalValue append(Context& c);
+	static constexpr int appendLineArgCount = 2;
+	static LocalValue append_line(Context& c);
+	// The UTF-8 char count of the built string.
+	static constexpr int getSizeArgCount = 1;
+	static LocalValue get_size(Context& c);
+	static constexpr int buildArgCount = 1;
+	static LocalValue build(Context& c);
+
+	// Strings are appended directly. Other values are converted the same way they are printed. The length is increased
+	// by the UTF-8 char count of the appended characters.
+	static void append(std::string& chars, size_t& length, const Value& value);
+
+	static void init(StringBuilder* self);
+	static void free(StringBuilder* self);
+	static void mark(StringBuilder* self, Allocator& allocator);
+
+	std::string chars;
+	// UTF-8 char count.
+	size_t length;
+};
+
+}
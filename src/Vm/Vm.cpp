@@ -1,7 +1,9 @@
 #include <Vm/Vm.hpp>
 #include <Vm/List.hpp>
 #include <Vm/Dict.hpp>
+#include <Vm/Range.hpp>
 #include <Vm/String.hpp>
+#include <Vm/StringBuilder.hpp>
 #include <Vm/Number.hpp>
 #include <Vm/Errors.hpp>
 #include <Utf8.hpp>
@@ -101,37 +103,40 @@ using namespace Voxl;
 	}
 
 #define TRY_PUSH_CALL_STACK() \
-	if (m_callStack.push() == false) \
+	if ((m_callStack.push() == false) && ((m_callStack.grow(1) == false) || (m_callStack.push() == false))) \
 	{ \
 		return fatalError("call stack overflow"); \
 	}
 
-#define TRY_PUSH_EXCEPTION_HANDLER() \
-	if (m_exceptionHandlers.push() == false) \
+// Pointers into the stack are invalidated.
+#define TRY_RESERVE_STACK(space) \
+	if ((m_stack.hasSpaceFor(space) == false) && (growStack(space) == false)) \
 	{ \
-		return fatalError("exception handler stack overflow"); \
+		return fatalError("stack overflow"); \
 	}
 
 Vm::Vm(Allocator& allocator)
 	: m_allocator(&allocator)
 	, m_errorReporter(nullptr)
 	, m_rootMarkingFunctionHandle(allocator.registerMarkingFunction(this, mark))
-	, m_initString(allocator.allocateStringConstant("$init").value)
-	, m_addString(allocator.allocateStringConstant("$add").value)
-	, m_subString(allocator.allocateStringConstant("$sub").value)
-	, m_mulString(allocator.allocateStringConstant("$mul").value)
-	, m_divString(allocator.allocateStringConstant("$div").value)
-	, m_modString(allocator.allocateStringConstant("$mod").value)
-	, m_ltString(allocator.allocateStringConstant("$lt").value)
-	, m_leString(allocator.allocateStringConstant("$le").value)
-	, m_gtString(allocator.allocateStringConstant("$gt").value)
-	, m_geString(allocator.allocateStringConstant("$ge").value)
-	, m_getIndexString(allocator.allocateStringConstant("$get_index").value)
-	, m_setIndexString(allocator.allocateStringConstant("$set_index").value)
-	, m_eqString(allocator.allocateStringConstant("$eq").value)
-	, m_strString(allocator.allocateStringConstant("$str").value)
-	, m_msgString(allocator.allocateStringConstant("msg").value)
-	, m_emptyString(allocator.allocateStringConstant("").value)
+	, m_initString(allocator.allocateStringConstant("$init"))
+	, m_addString(allocator.allocateStringConstant("$add"))
+	, m_subString(allocator.allocateStringConstant("$sub"))
+	, m_mulString(allocator.allocateStringConstant("$mul"))
+	, m_divString(allocator.allocateStringConstant("$div"))
+	, m_modString(allocator.allocateStringConstant("$mod"))
+	, m_ltString(allocator.allocateStringConstant("$lt"))
+	, m_leString(allocator.allocateStringConstant("$le"))
+	, m_gtString(allocator.allocateStringConstant("$gt"))
+	, m_geString(allocator.allocateStringConstant("$ge"))
+	, m_getIndexString(allocator.allocateStringConstant("$get_index"))
+	, m_setIndexString(allocator.allocateStringConstant("$set_index"))
+	, m_eqString(allocator.allocateStringConstant("$eq"))
+	, m_strString(allocator.allocateStringConstant("$str"))
+	, m_iterString(allocator.allocateStringConstant("$iter"))
+	, m_nextString(allocator.allocateStringConstant("$next"))
+	, m_msgString(allocator.allocateStringConstant("msg"))
+	, m_emptyString(allocator.allocateStringConstant(""))
 // The GC might run during the constructor so the values have to be checked inside mark for begin null.
 // This also may be fixable by making constant classes that are always marked.
 // Currently only strings and functions can be constant because they don't contain any changing data.
@@ -140,6 +145,10 @@ Vm::Vm(Allocator& allocator)
 	, m_listType(nullptr)
 	, m_listIteratorType(nullptr)
 	, m_dictType(nullptr)
+	, m_dictIteratorType(nullptr)
+	, m_rangeType(nullptr)
+	, m_rangeIteratorType(nullptr)
+	, m_stringBuilderType(nullptr)
 	, m_numberType(nullptr)
 	, m_intType(nullptr)
 	, m_floatType(nullptr)
@@ -152,17 +161,39 @@ Vm::Vm(Allocator& allocator)
 	, m_nameErrorType(nullptr)
 	, m_zeroDivisionErrorType(nullptr)
 	, m_finallyBlockDepth(0)
+	, m_openUpvalues(nullptr)
 {
+	const std::pair<SpecialMethod, ObjString*> specialMethodNames[] = {
+		{ SpecialMethod::Add, m_addString },
+		{ SpecialMethod::Sub, m_subString },
+		{ SpecialMethod::Mul, m_mulString },
+		{ SpecialMethod::Div, m_divString },
+		{ SpecialMethod::Mod, m_modString },
+		{ SpecialMethod::Lt, m_ltString },
+		{ SpecialMethod::Le, m_leString },
+		{ SpecialMethod::Gt, m_gtString },
+		{ SpecialMethod::Ge, m_geString },
+		{ SpecialMethod::GetIndex, m_getIndexString },
+		{ SpecialMethod::SetIndex, m_setIndexString },
+		{ SpecialMethod::Eq, m_eqString },
+		{ SpecialMethod::Str, m_strString },
+	};
+	static_assert(std::size(specialMethodNames) == ObjClass::SPECIAL_METHOD_COUNT);
+	for (const auto& [method, name] : specialMethodNames)
+	{
+		m_specialMethodNames[static_cast<size_t>(method)] = name;
+	}
+
 	// Cannot use allocateNativeClass overload with initializer list inside constructor because the GC might run. 
 
 	auto addFn = [this](ObjClass* type, std::string_view name, NativeFunction function, int argCount)
 	{
-		auto nameObj = m_allocator->allocateStringConstant(name).value;
+		auto nameObj = m_allocator->allocateStringConstant(name);
 		auto functionObj = m_allocator->allocateForeignFunction(nameObj, function, argCount, &m_builtins, nullptr);
-		type->fields.set(nameObj, Value(functionObj));
+		setClassField(type, nameObj, Value(functionObj));
 	};
 
-	auto listString = m_allocator->allocateStringConstant("List").value;
+	auto listString = m_allocator->allocateStringConstant("List");
 	m_listType = m_allocator->allocateNativeClass(listString, List::init, List::free);
 	addFn(m_listType, "$iter", List::iter, List::iterArgCount);
 	addFn(m_listType, "push", List::push, List::pushArgCount);
@@ -170,18 +201,44 @@ Vm::Vm(Allocator& allocator)
 	addFn(m_listType, "$get_index", List::get_index, List::getIndexArgCount);
 	addFn(m_listType, "$set_index", List::set_index, List::setIndexArgCount);
 
-	auto listIteratorString = m_allocator->allocateStringConstant("_ListIterator").value;
+	auto listIteratorString = m_allocator->allocateStringConstant("_ListIterator");
 	m_listIteratorType = m_allocator->allocateNativeClass<ListIterator>(listIteratorString, ListIterator::construct, nullptr);
 	addFn(m_listIteratorType, "$init", ListIterator::init, ListIterator::initArgCount);
 	addFn(m_listIteratorType, "$next", ListIterator::next, ListIterator::nextArgCount);
 
-	auto dictString = m_allocator->allocateStringConstant("Dict").value;
+	auto dictString = m_allocator->allocateStringConstant("Dict");
 	m_dictType = m_allocator->allocateNativeClass(dictString, Dict::init, Dict::free);
+	addFn(m_dictType, "$iter", Dict::iter, Dict::iterArgCount);
 	addFn(m_dictType, "$get_index", Dict::get_index, Dict::getIndexArgCount);
 	addFn(m_dictType, "$set_index", Dict::set_index, Dict::setIndexArgCount);
 	addFn(m_dictType, "size", Dict::get_size, Dict::getSizeArgCount);
 
-	auto numberString = m_allocator->allocateStringConstant("Number").value;
+	auto dictIteratorString = m_allocator->allocateStringConstant("_DictIterator");
+	m_dictIteratorType = m_allocator->allocateNativeClass<DictIterator>(
+		dictIteratorString, DictIterator::construct, nullptr);
+	addFn(m_dictIteratorType, "$init", DictIterator::init, DictIterator::initArgCount);
+	addFn(m_dictIteratorType, "$next", DictIterator::next, DictIterator::nextArgCount);
+
+	auto rangeString = m_allocator->allocateStringConstant("Range");
+	m_rangeType = m_allocator->allocateNativeClass<Range>(rangeString, Range::construct, nullptr);
+	addFn(m_rangeType, "$init", Range::init, Range::initArgCount);
+	addFn(m_rangeType, "$iter", Range::iter, Range::iterArgCount);
+	addFn(m_rangeType, "size", Range::get_size, Range::getSizeArgCount);
+
+	auto rangeIteratorString = m_allocator->allocateStringConstant("_RangeIterator");
+	m_rangeIteratorType = m_allocator->allocateNativeClass<RangeIterator>(
+		rangeIteratorString, RangeIterator::construct, nullptr);
+	addFn(m_rangeIteratorType, "$init", RangeIterator::init, RangeIterator::initArgCount);
+	addFn(m_rangeIteratorType, "$next", RangeIterator::next, RangeIterator::nextArgCount);
+
+	auto stringBuilderString = m_allocator->allocateStringConstant("StringBuilder");
+	m_stringBuilderType = m_allocator->allocateNativeClass(stringBuilderString, StringBuilder::init, StringBuilder::free);
+	addFn(m_stringBuilderType, "append", StringBuilder::append, StringBuilder::appendArgCount);
+	addFn(m_stringBuilderType, "append_line", StringBuilder::append_line, StringBuilder::appendLineArgCount);
+	addFn(m_stringBuilderType, "size", StringBuilder::get_size, StringBuilder::getSizeArgCount);
+	addFn(m_stringBuilderType, "build", StringBuilder::build, StringBuilder::buildArgCount);
+
+	auto numberString = m_allocator->allocateStringConstant("Number");
 	m_numberType = m_allocator->allocateClass(numberString);
 	addFn(m_numberType, "floor", Number::floor, Number::floorArgCount);
 	addFn(m_numberType, "ceil", Number::ceil, Number::ceilArgCount);
@@ -194,42 +251,42 @@ Vm::Vm(Allocator& allocator)
 	addFn(m_numberType, "cos", Number::cos, Number::cosArgCount);
 	addFn(m_numberType, "tan", Number::tan, Number::tanArgCount);
 
-	auto intString = m_allocator->allocateStringConstant("Int").value;
+	auto intString = m_allocator->allocateStringConstant("Int");
 	m_intType = m_allocator->allocateClass(intString);
-	m_intType->superclass = *m_numberType;
+	inherit(m_intType, m_numberType);
 
-	auto floatString = m_allocator->allocateStringConstant("Float").value;
+	auto floatString = m_allocator->allocateStringConstant("Float");
 	m_floatType = m_allocator->allocateClass(floatString);
-	m_floatType->superclass = *m_numberType;
+	inherit(m_floatType, m_numberType);
 
-	auto boolString = m_allocator->allocateStringConstant("Bool").value;
+	auto boolString = m_allocator->allocateStringConstant("Bool");
 	m_boolType = m_allocator->allocateClass(boolString);
 
-	auto typeString = m_allocator->allocateStringConstant("Type").value;
+	auto typeString = m_allocator->allocateStringConstant("Type");
 	m_typeType = m_allocator->allocateClass(typeString);
 
-	auto nullString = m_allocator->allocateStringConstant("String").value;
+	auto nullString = m_allocator->allocateStringConstant("String");
 	m_nullType = m_allocator->allocateClass(nullString);
 
-	auto stringString = m_allocator->allocateStringConstant("String").value;
+	auto stringString = m_allocator->allocateStringConstant("String");
 	m_stringType = m_allocator->allocateClass(stringString);
 	addFn(m_stringType, "len", String::len, String::lenArgCount);
 	addFn(m_stringType, "$hash", String::hash, String::hashArgCount);
 
-	auto stopIterationString = m_allocator->allocateStringConstant("StopIteration").value;
+	auto stopIterationString = m_allocator->allocateStringConstant("StopIteration");
 	m_stopIterationType = m_allocator->allocateClass(stopIterationString);
 
-	auto typeErrorString = m_allocator->allocateStringConstant("TypeError").value;
+	auto typeErrorString = m_allocator->allocateStringConstant("TypeError");
 	m_typeErrorType = m_allocator->allocateClass(typeErrorString);
 	addFn(m_typeErrorType, "$init", GenericStringError::init, GenericStringError::initArgCount);
 	addFn(m_typeErrorType, "$str", GenericStringError::str, GenericStringError::strArgCount);
 
-	auto nameErrorString = m_allocator->allocateStringConstant("NameError").value;
+	auto nameErrorString = m_allocator->allocateStringConstant("NameError");
 	m_nameErrorType = m_allocator->allocateClass(nameErrorString);
 	addFn(m_nameErrorType, "$init", GenericStringError::init, GenericStringError::initArgCount);
 	addFn(m_nameErrorType, "$str", GenericStringError::str, GenericStringError::strArgCount);
 
-	auto zeroDivisonErrorString = m_allocator->allocateStringConstant("ZeroDivisionError").value;
+	auto zeroDivisonErrorString = m_allocator->allocateStringConstant("ZeroDivisionError");
 	m_zeroDivisionErrorType = m_allocator->allocateClass(zeroDivisonErrorString);
 	addFn(m_zeroDivisionErrorType, "$init", GenericStringError::init, GenericStringError::initArgCount);
 	addFn(m_zeroDivisionErrorType, "$str", GenericStringError::str, GenericStringError::strArgCount);
@@ -247,7 +304,7 @@ VmResult Vm::execute(
 	ErrorReporter& errorReporter)
 {
 	auto path = std::filesystem::absolute(sourceInfo.displayedFilename);
-	m_modules.set(m_allocator->allocateStringConstant(std::string_view(path.string())).value, Value(module));
+	m_modules.set(m_allocator->allocateStringConstant(std::string_view(path.string())), Value(module));
 
 	m_scanner = &scanner;
 	m_parser = &parser;
@@ -255,6 +312,8 @@ VmResult Vm::execute(
 	m_sourceInfo = &sourceInfo;
 	m_compiler->m_module = nullptr;
 
+	// Upvalues might be left open if the previous execution failed.
+	closeUpvalues(m_stack.data());
 	m_callStack.clear();
 	m_stack.clear();
 	m_errorReporter = &errorReporter;
@@ -268,12 +327,14 @@ VmResult Vm::execute(
 	try 
 	{
 		const auto result = run();
+#ifdef VOXL_DEBUG_PRINT_INLINE_CACHE_STATS
+		debugPrintInlineCacheStats();
+#endif
 		if (result.type == ResultType::Ok)
 		{
 			// The program should always finish without anything on both the excecution and call stack.
 			ASSERT(m_stack.isEmpty());
 			ASSERT(m_callStack.isEmpty());
-			ASSERT(m_exceptionHandlers.isEmpty());
 			ASSERT(m_finallyBlockDepth == 0);
 			return VmResult::Success;
 		}
@@ -289,6 +350,10 @@ void Vm::reset()
 	m_modules.clear();
 	m_builtins.set(m_listType->name, Value(m_listType));
 	m_builtins.set(m_dictType->name, Value(m_dictType));
+	m_builtins.set(m_dictIteratorType->name, Value(m_dictIteratorType));
+	m_builtins.set(m_rangeType->name, Value(m_rangeType));
+	m_builtins.set(m_rangeIteratorType->name, Value(m_rangeIteratorType));
+	m_builtins.set(m_stringBuilderType->name, Value(m_stringBuilderType));
 	m_builtins.set(m_numberType->name, Value(m_numberType));
 	m_builtins.set(m_intType->name, Value(m_intType));
 	m_builtins.set(m_floatType->name, Value(m_floatType));
@@ -301,54 +366,140 @@ void Vm::reset()
 	m_builtins.set(m_zeroDivisionErrorType->name, Value(m_zeroDivisionErrorType));
 }
 
+void Vm::beforeInstruction()
+{
+#ifdef VOXL_DEBUG_PRINT_VM_EXECUTION_TRACE
+	debugPrintStack();
+	if (m_callStack.top().callable->isFunction())
+	{
+		const auto function = m_callStack.top().callable->asFunction();
+		disassembleInstruction(
+			function->byteCode,
+			function->byteCode.offsetOf(m_instructionPointer));
+		std::cout << '\n';
+	}
+	else
+	{
+		std::cout << "cannot disassemble non function\n";
+		ASSERT_NOT_REACHED();
+	}
+#endif
+
+#ifdef VOXL_DEBUG_STRESS_TEST_GC
+	m_allocator->runGc();
+#endif
+}
+
+void Vm::quicken(Op op)
+{
+	// The code is only modified by the vm while executing, so it is stored as const everywhere else.
+	const auto instruction = const_cast<CodeUnit*>(m_instructionPointer - 1);
+	*instruction = static_cast<CodeUnit>(op);
+#ifdef VOXL_PREDECODED_BYTECODE
+	// Keep the original code in sync so the disassembler shows the quickened op.
+	auto& byteCode = m_callStack.top().callable->asFunction()->byteCode;
+	byteCode.code[byteCode.offsetOf(instruction)] = static_cast<uint8_t>(op);
+#endif
+}
+
+// Read src/Vm/branch_prediction.txt. MSVC doesn't support taking the address of a label so it always uses the switch.
+#if defined(VOXL_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+	#define VOXL_USE_COMPUTED_GOTO
+#endif
+
+#ifdef VOXL_USE_COMPUTED_GOTO
+	// The switch is still used for the first instruction and after an exception is handled. Every other instruction
+	// jumps directly to the next handler so each handler has it's own indirect jump.
+	#define CASE(opName) case Op::opName: op##opName
+	#define DISPATCH() \
+		do \
+		{ \
+			beforeInstruction(); \
+			goto *dispatchTable[*m_instructionPointer++]; \
+		} while (false)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+	#define CASE(opName) case Op::opName
+	#define DISPATCH() break
+#endif
+
 #define TRY TRY_INSIDE_RUN
 #define TRY_WITH_VALUE TRY_WITH_VALUE_INSIDE_RUN
+
+// The result of a quickened op. Ints that don't fit into a value are allocated.
+static Value opResult(Int value, Allocator& allocator)
+{
+	return Value::intNum(value, allocator);
+}
+
+static Value opResult(Float value, Allocator&)
+{
+	return Value(value);
+}
+
+static Value opResult(bool value, Allocator&)
+{
+	return Value(value);
+}
+
 Vm::Result Vm::run()
 {
+#ifdef VOXL_USE_COMPUTED_GOTO
+	// Has to be in the same order as Op.
+	static const void* const dispatchTable[] = {
+		&&opAdd, &&opSubtract, &&opMultiply, &&opDivide, &&opModulo, &&opConcat,
+		&&opLess, &&opLessEqual, &&opMore, &&opMoreEqual, &&opEquals,
+		&&opNegate, &&opNot,
+		&&opGetConstant, &&opGetLocal, &&opSetLocal, &&opCreateGlobal, &&opGetGlobal, &&opSetGlobal,
+		&&opGetUpvalue, &&opSetUpvalue, &&opGetField, &&opSetField, &&opStoreMethod, &&opGetIndex, &&opSetIndex,
+		&&opLoadNull, &&opLoadTrue, &&opLoadFalse,
+		&&opCreateList, &&opListPush, &&opCreateDict, &&opDictSet,
+		&&opCreateClass, &&opClosure,
+		&&opJump, &&opJumpIfTrue, &&opJumpIfFalse, &&opJumpIfFalseAndPop, &&opJumpBack,
+		&&opCall, &&opReturn,
+		&&opFinallyBegin, &&opFinallyEnd, &&opThrow, &&invalidOp /* Rethrow */,
+		&&opCloseUpvalue, &&opMatchClass, &&opPopStack,
+		&&opImport, &&opModuleSetLoaded, &&opModuleImportAllToGlobalNamespace,
+		&&opCloneTop, &&opCloneTopTwo,
+		&&invalidOp /* ExpressionStatementBegin */, &&invalidOp /* ExpressionStatementReturn */,
+		&&opInherit, &&opInvoke,
+		&&opAddInt, &&opAddFloat, &&opSubtractInt, &&opSubtractFloat, &&opMultiplyInt, &&opMultiplyFloat,
+		&&opLessInt, &&opLessFloat, &&opLessEqualInt, &&opLessEqualFloat,
+		&&opMoreInt, &&opMoreFloat, &&opMoreEqualInt, &&opMoreEqualFloat,
+		&&opAddLocals, &&opLessLocalConstantJumpIfFalse, &&opLessEqualLocalConstantJumpIfFalse,
+		&&opMoreLocalConstantJumpIfFalse, &&opMoreEqualLocalConstantJumpIfFalse, &&opAddLocalConstant,
+		&&opTailCall,
+		&&opGetIter, &&opForIter, &&opForRangeBegin, &&opForRange,
+		&&opConcatN,
+	};
+	static_assert(std::size(dispatchTable) == static_cast<size_t>(Op::ConcatN) + 1);
+#endif
+
 	for (;;)
 	{
-	#ifdef VOXL_DEBUG_PRINT_VM_EXECUTION_TRACE
-		debugPrintStack();
-		if (m_callStack.top().callable->isFunction())
-		{
-			const auto function = m_callStack.top().callable->asFunction();
-			disassembleInstruction(
-				function->byteCode,
-				m_instructionPointer - function->byteCode.code.data(), *m_allocator);
-			std::cout << '\n';
-		}
-		else
-		{
-			std::cout << "cannot disassemble non function\n";
-			ASSERT_NOT_REACHED();
-		}
-		
-	#endif
-
-	#ifdef VOXL_DEBUG_STRESS_TEST_GC
-		m_allocator->runGc();
-	#endif
+		beforeInstruction();
 		auto op = static_cast<Op>(*m_instructionPointer);
 		m_instructionPointer++;
 
 		switch (op)
 		{
 
-#define BINARY_ARITHMETIC_OP(op, overloadNameString) \
+#define BINARY_ARITHMETIC_OP(op, overloadMethod, opName) \
+	generic##opName: \
 	{ \
 		const auto& lhs = m_stack.peek(1); \
 		const auto& rhs = m_stack.peek(0); \
-		if (lhs.isObj() && lhs.as.obj->isInstance()) \
+		if (lhs.isObj() && lhs.asObj()->isInstance()) \
 		{ \
-			auto instance = lhs.as.obj->asInstance(); \
-			auto optMethod = instance->class_->fields.get(overloadNameString); \
-			if (optMethod.has_value()) \
+			const auto& method = specialMethod(*lhs.asObj()->asInstance()->class_, SpecialMethod::overloadMethod); \
+			if (method.isNull() == false) \
 			{ \
-				TRY(callValue(*optMethod, 2, 0)); \
+				TRY(callValue(method, 2, 0)); \
 			} \
 			else \
 			{ \
-				goto unsupportedTypes##overloadNameString; \
+				goto unsupportedTypes##opName; \
 			} \
 		} \
 		else \
@@ -356,51 +507,52 @@ Vm::Result Vm::run()
 			m_stack.pop(); \
 			if (lhs.isInt() && rhs.isInt()) \
 			{ \
-				m_stack.top() = Value(lhs.as.intNumber op rhs.as.intNumber); \
+				m_stack.top() = Value::intNum(lhs.asInt() op rhs.asInt(), *m_allocator); \
+				quicken(Op::opName##Int); \
 			} \
 			else if (lhs.isFloat() && rhs.isFloat()) \
 			{ \
-				m_stack.top() = Value(lhs.as.floatNumber op rhs.as.floatNumber); \
+				m_stack.top() = Value(lhs.asFloat() op rhs.asFloat()); \
+				quicken(Op::opName##Float); \
 			} \
 			else if (lhs.isFloat() && rhs.isInt()) \
 			{ \
-				m_stack.top() = Value(lhs.as.floatNumber op static_cast<Float>(rhs.as.intNumber)); \
+				m_stack.top() = Value(lhs.asFloat() op static_cast<Float>(rhs.asInt())); \
 			} \
 			else if (lhs.isInt() && rhs.isFloat()) \
 			{ \
-				m_stack.top() = Value(static_cast<Float>(lhs.as.intNumber) op rhs.as.floatNumber); \
+				m_stack.top() = Value(static_cast<Float>(lhs.asInt()) op rhs.asFloat()); \
 			} \
 			else \
 			{ \
-				goto unsupportedTypes##overloadNameString; \
+				goto unsupportedTypes##opName; \
 			} \
 		} \
-		break; \
-		unsupportedTypes##overloadNameString: \
+		DISPATCH(); \
+		unsupportedTypes##opName: \
 		TRY(throwTypeErrorUnsupportedOperandTypesFor(#op, lhs, rhs)); \
-		break; \
+		DISPATCH(); \
 	}
 		// Making function that work both from the vm and from the ffi is hard because for simple types the values don't have to be on the stack,
 		// but for overload calls they need to be. It also requires calling callFromVmAndReturn. The simples way to implement this would be
 		// to just make everything a function even for basic types. 
-		case Op::Add: BINARY_ARITHMETIC_OP(+, m_addString)
-		case Op::Subtract: BINARY_ARITHMETIC_OP(-, m_subString)
-		case Op::Multiply: BINARY_ARITHMETIC_OP(*, m_mulString)
+		CASE(Add): BINARY_ARITHMETIC_OP(+, Add, Add)
+		CASE(Subtract): BINARY_ARITHMETIC_OP(-, Sub, Subtract)
+		CASE(Multiply): BINARY_ARITHMETIC_OP(*, Mul, Multiply)
 #undef BINARY_ARITHMETIC_OP
-		case Op::Divide: 
+		CASE(Divide): 
 		{
 			const auto& lhs = m_stack.peek(1);
 			const auto& rhs = m_stack.peek(0);
-			if (lhs.isObj() && lhs.as.obj->isInstance())
+			if (lhs.isObj() && lhs.asObj()->isInstance())
 			{
-				auto instance = lhs.as.obj->asInstance();
-				auto optMethod = instance->class_->fields.get(m_divString);
-				if (optMethod.has_value())
-					TRY(callValue(*optMethod, 2, 0));
+				const auto& method = specialMethod(*lhs.asObj()->asInstance()->class_, SpecialMethod::Div);
+				if (method.isNull() == false)
+					TRY(callValue(method, 2, 0));
 				else
 					goto noOverloadForDivision;
 
-				break;
+				DISPATCH();
 			}
 			else
 			{
@@ -426,33 +578,32 @@ Vm::Result Vm::run()
 				m_stack.pop();
 				m_stack.top() = Value::floatNum(a / b);
 
-				break;
+				DISPATCH();
 			}
-			break;
+			DISPATCH();
 		noOverloadForDivision:
 			TRY(throwTypeErrorUnsupportedOperandTypesFor("/", lhs, rhs));
-			break;
+			DISPATCH();
 		}
-		case Op::Modulo: 
+		CASE(Modulo): 
 		{
 			const auto& lhs = m_stack.peek(1);
 			const auto& rhs = m_stack.peek(0);
-			if (lhs.isObj() && lhs.as.obj->isInstance())
+			if (lhs.isObj() && lhs.asObj()->isInstance())
 			{
-				auto instance = lhs.as.obj->asInstance();
-				auto optMethod = instance->class_->fields.get(m_modString);
-				if (optMethod.has_value())
-					TRY(callValue(*optMethod, 2, 0));
+				const auto& method = specialMethod(*lhs.asObj()->asInstance()->class_, SpecialMethod::Mod);
+				if (method.isNull() == false)
+					TRY(callValue(method, 2, 0));
 				else
 					goto noOverloadForModulo;
 
-				break;
+				DISPATCH();
 			}
 			else if (lhs.isInt() && rhs.isInt())
 			{
 				m_stack.pop();
-				m_stack.top() = Value::intNum(lhs.asInt() % rhs.asInt());
-				break;
+				m_stack.top() = Value::intNum(lhs.asInt() % rhs.asInt(), *m_allocator);
+				DISPATCH();
 			}
 			else
 			{
@@ -478,34 +629,36 @@ Vm::Result Vm::run()
 				m_stack.pop();
 				m_stack.top() = Value::floatNum(fmod(a, b));
 
-				break;
+				DISPATCH();
 			}
-			break;
+			DISPATCH();
 		noOverloadForModulo:
 			TRY(throwTypeErrorUnsupportedOperandTypesFor("%", lhs, rhs));
-			break;
+			DISPATCH();
 		}
 
-#define BINARY_COMPARASION_OP(op, overloadNameString) \
+#define BINARY_COMPARASION_OP(op, overloadMethod, opName) \
+	generic##opName: \
 	{ \
-		const auto& lhs = m_stack.peek(1); \
-		const auto& rhs = m_stack.peek(0); \
+		auto& lhs = m_stack.peek(1); \
+		auto& rhs = m_stack.peek(0); \
 		if (lhs.isObj()) \
 		{ \
-			if (rhs.isObj() && lhs.as.obj->isString() && rhs.as.obj->isString()) \
+			flattenRope(lhs); \
+			flattenRope(rhs); \
+			if (rhs.isObj() && lhs.asObj()->isString() && rhs.asObj()->isString()) \
 			{ \
-				auto left = lhs.as.obj->asString(); \
-				auto right = rhs.as.obj->asString(); \
+				auto left = lhs.asObj()->asString(); \
+				auto right = rhs.asObj()->asString(); \
 				m_stack.pop(); \
 				m_stack.top() = Value(Utf8::strcmp(left->chars, left->size, right->chars, right->size) op 0); \
 			} \
-			else if (lhs.as.obj->isInstance()) \
+			else if (lhs.asObj()->isInstance()) \
 			{ \
-				auto instance = lhs.as.obj->asInstance(); \
-				auto optMethod = instance->class_->fields.get(overloadNameString); \
-				if (optMethod.has_value()) \
+				const auto& method = specialMethod(*lhs.asObj()->asInstance()->class_, SpecialMethod::overloadMethod); \
+				if (method.isNull() == false) \
 				{ \
-					TRY(callValue(*optMethod, 2, 0)); \
+					TRY(callValue(method, 2, 0)); \
 				} \
 				else \
 				{ \
@@ -518,249 +671,406 @@ Vm::Result Vm::run()
 			m_stack.pop(); \
 			if (lhs.isInt() && rhs.isInt()) \
 			{ \
-				m_stack.top() = Value(lhs.as.intNumber op rhs.as.intNumber); \
+				m_stack.top() = Value(lhs.asInt() op rhs.asInt()); \
+				quicken(Op::opName##Int); \
 			} \
 			else if (lhs.isFloat() && rhs.isFloat()) \
 			{ \
-				m_stack.top() = Value(lhs.as.floatNumber op rhs.as.floatNumber); \
+				m_stack.top() = Value(lhs.asFloat() op rhs.asFloat()); \
+				quicken(Op::opName##Float); \
 			} \
 			else if (lhs.isFloat() && rhs.isInt()) \
 			{ \
-				m_stack.top() = Value(lhs.as.floatNumber op static_cast<Float>(rhs.as.intNumber)); \
+				m_stack.top() = Value(lhs.asFloat() op static_cast<Float>(rhs.asInt())); \
 			} \
 			else if (lhs.isInt() && rhs.isFloat()) \
 			{ \
-				m_stack.top() = Value(static_cast<Float>(lhs.as.intNumber) op rhs.as.floatNumber); \
+				m_stack.top() = Value(static_cast<Float>(lhs.asInt()) op rhs.asFloat()); \
 			} \
 			else \
 			{ \
 				return fatalError("no operator " #op " for these types"); \
 			} \
 		} \
-		break; \
+		DISPATCH(); \
 	}
 
-		case Op::Less: BINARY_COMPARASION_OP(<, m_ltString)
-		case Op::LessEqual: BINARY_COMPARASION_OP(<=, m_leString)
-		case Op::More: BINARY_COMPARASION_OP(>, m_gtString)
-		case Op::MoreEqual: BINARY_COMPARASION_OP(>=, m_geString)
+		CASE(Less): BINARY_COMPARASION_OP(<, Lt, Less)
+		CASE(LessEqual): BINARY_COMPARASION_OP(<=, Le, LessEqual)
+		CASE(More): BINARY_COMPARASION_OP(>, Gt, More)
+		CASE(MoreEqual): BINARY_COMPARASION_OP(>=, Ge, MoreEqual)
 #undef BINARY_COMPARASION_OP
 
-		case Op::Equals:
+// If the operands don't have the expected type the instruction is replaced with the generic version which handles
+// all the types and can quicken it again.
+#define QUICKENED_BINARY_OP(op, genericOpName, type) \
+	{ \
+		const auto& lhs = m_stack.peek(1); \
+		const auto& rhs = m_stack.peek(0); \
+		if (lhs.is##type() && rhs.is##type()) \
+		{ \
+			const auto result = opResult(lhs.as##type() op rhs.as##type(), *m_allocator); \
+			m_stack.pop(); \
+			m_stack.top() = result; \
+			DISPATCH(); \
+		} \
+		quicken(Op::genericOpName); \
+		goto generic##genericOpName; \
+	}
+
+		CASE(AddInt): QUICKENED_BINARY_OP(+, Add, Int)
+		CASE(AddFloat): QUICKENED_BINARY_OP(+, Add, Float)
+		CASE(SubtractInt): QUICKENED_BINARY_OP(-, Subtract, Int)
+		CASE(SubtractFloat): QUICKENED_BINARY_OP(-, Subtract, Float)
+		CASE(MultiplyInt): QUICKENED_BINARY_OP(*, Multiply, Int)
+		CASE(MultiplyFloat): QUICKENED_BINARY_OP(*, Multiply, Float)
+		CASE(LessInt): QUICKENED_BINARY_OP(<, Less, Int)
+		CASE(LessFloat): QUICKENED_BINARY_OP(<, Less, Float)
+		CASE(LessEqualInt): QUICKENED_BINARY_OP(<=, LessEqual, Int)
+		CASE(LessEqualFloat): QUICKENED_BINARY_OP(<=, LessEqual, Float)
+		CASE(MoreInt): QUICKENED_BINARY_OP(>, More, Int)
+		CASE(MoreFloat): QUICKENED_BINARY_OP(>, More, Float)
+		CASE(MoreEqualInt): QUICKENED_BINARY_OP(>=, MoreEqual, Int)
+		CASE(MoreEqualFloat): QUICKENED_BINARY_OP(>=, MoreEqual, Float)
+#undef QUICKENED_BINARY_OP
+
+// The superinstructions handle the same types the generic ops quicken on, so when they fall back to the generic op it
+// won't try to quicken the superinstruction.
+		CASE(AddLocals):
+		{
+			const auto lhs = m_callStack.top().values[readUint32()];
+			const auto rhs = m_callStack.top().values[readUint32()];
+			if (lhs.isInt() && rhs.isInt())
+			{
+				TRY_PUSH(Value::intNum(lhs.asInt() + rhs.asInt(), *m_allocator));
+				DISPATCH();
+			}
+			if (lhs.isFloat() && rhs.isFloat())
+			{
+				TRY_PUSH(Value(lhs.asFloat() + rhs.asFloat()));
+				DISPATCH();
+			}
+			TRY_PUSH(lhs);
+			TRY_PUSH(rhs);
+			goto genericAdd;
+		}
+
+#define LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE(op, genericOpName) \
+	{ \
+		const auto lhs = m_callStack.top().values[readUint32()]; \
+		const auto rhs = m_constants[readUint32()]; \
+		bool isTrue; \
+		if (lhs.isInt() && rhs.isInt()) \
+		{ \
+			isTrue = lhs.asInt() op rhs.asInt(); \
+		} \
+		else if (lhs.isFloat() && rhs.isFloat()) \
+		{ \
+			isTrue = lhs.asFloat() op rhs.asFloat(); \
+		} \
+		else \
+		{ \
+			TRY_PUSH(lhs); \
+			TRY_PUSH(rhs); \
+			goto generic##genericOpName; \
+		} \
+		/* Execute the JumpIfFalseAndPop that follows. */ \
+		m_instructionPointer++; \
+		const auto jump = readUint32(); \
+		if (isTrue == false) \
+		{ \
+			m_instructionPointer += jump; \
+		} \
+		DISPATCH(); \
+	}
+
+		CASE(LessLocalConstantJumpIfFalse): LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE(<, Less)
+		CASE(LessEqualLocalConstantJumpIfFalse): LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE(<=, LessEqual)
+		CASE(MoreLocalConstantJumpIfFalse): LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE(>, More)
+		CASE(MoreEqualLocalConstantJumpIfFalse): LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE(>=, MoreEqual)
+#undef LOCAL_CONSTANT_COMPARISON_JUMP_IF_FALSE
+
+		CASE(AddLocalConstant):
+		{
+			auto& local = m_callStack.top().values[readUint32()];
+			const auto constant = m_constants[readUint32()];
+			if (local.isInt() && constant.isInt())
+			{
+				local = Value::intNum(local.asInt() + constant.asInt(), *m_allocator);
+			}
+			else if (local.isFloat() && constant.isFloat())
+			{
+				local = Value(local.asFloat() + constant.asFloat());
+			}
+			else
+			{
+				const auto value = local;
+				TRY_PUSH(value);
+				TRY_PUSH(constant);
+				goto genericAdd;
+			}
+			// Skip the SetLocal and PopStack that follow.
+			m_instructionPointer++;
+			readUint32();
+			m_instructionPointer++;
+			DISPATCH();
+		}
+
+		CASE(Equals):
 		{
+			const auto result = primitiveEquals(m_stack.peek(1), m_stack.peek(0));
+			if (result.has_value())
+			{
+				m_stack.pop();
+				m_stack.top() = Value(*result);
+				DISPATCH();
+			}
 			TRY(equals());
-			break;
+			DISPATCH();
 		}
 
-		case Op::Concat:
+		CASE(Concat):
 		{
-			const auto& lhs = m_stack.peek(1);
-			const auto& rhs = m_stack.peek(0);
-			std::stringstream result;
-			// Could optmize this by not recalculating the length using Utf8::strlen every time.
-			// Could also create an stream for ObjString* objects to avoid pointless allocating in std::stringstream.
-			// Could store a reserved stringstream inside the vm. There may be an issue if a native function is called
-			// which then calls a normal function which calls an overload for printing.
-			result << lhs << rhs;
-			ObjString* string = m_allocator->allocateString(result.str());
-			m_stack.pop();
+			// Operands that aren't strings are converted the same way they are printed. They are replaced on the stack
+			// so they stay reachable while the result is allocated.
+			for (size_t i = 0; i < 2; i++)
+			{
+				auto& operand = m_stack.peek(i);
+				if (operand.isObj() && (operand.asObj()->isString() || operand.asObj()->isRope()))
+					continue;
+				std::stringstream result;
+				result << operand;
+				operand = Value(m_allocator->allocateString(result.str()));
+			}
+			const auto result = m_allocator->allocateConcatenation(m_stack.peek(1).asObj(), m_stack.peek(0).asObj());
 			m_stack.pop();
-			TRY_PUSH(Value(string));
-			break;
+			m_stack.top() = Value(result);
+			DISPATCH();
+		}
+
+		CASE(ConcatN):
+		{
+			const auto count = readUint32();
+			const auto parts = &m_stack.peek(count - 1);
+			const auto& first = parts[0];
+			Value result;
+			// Strings built in a loop using s = s ++ a ++ b stay ropes so only the new parts are copied.
+			if (first.isObj()
+				&& (first.asObj()->isString() || first.asObj()->isRope())
+				&& (ObjRope::stringSize(first.asObj()) >= ObjRope::MIN_SIZE))
+			{
+				// The joined string replaces the second part so it stays reachable while the rope is allocated.
+				parts[1] = Value(joinStrings(parts + 1, count - 1));
+				result = Value(m_allocator->allocateConcatenation(first.asObj(), parts[1].asObj()));
+			}
+			else
+			{
+				result = Value(joinStrings(parts, count));
+			}
+			m_stack.popN(count - 1);
+			m_stack.top() = result;
+			DISPATCH();
 		}
 
-		case Op::Negate:
+		CASE(Negate):
 		{
 			auto& value = m_stack.peek(0);
-			if (value.type == ValueType::Int)
+			if (value.isInt())
 			{
-				value.as.intNumber = -value.as.intNumber;
+				value = Value::intNum(-value.asInt(), *m_allocator);
 			}
 			else
 			{
 				return fatalError("can only negate numers");
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::Not:
+		CASE(Not):
 		{
 			auto& value = m_stack.peek(0);
 			if (value.isBool())
 			{
-				value.as.boolean = !value.as.boolean;
+				value = Value(!value.asBool());
 			}
 			else
 			{
 				return fatalError("is not bool");
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::GetConstant:
+		CASE(GetConstant):
 		{
 			const auto constantIndex = readUint32();
-			TRY_PUSH(m_allocator->getConstant(constantIndex));
-			break;
+			TRY_PUSH(m_constants[constantIndex]);
+			DISPATCH();
 		}
 
-		case Op::GetLocal:
+		CASE(GetLocal):
 		{
 			auto stackOffset = readUint32();
 			TRY_PUSH(m_callStack.top().values[stackOffset]);
-			break;
+			DISPATCH();
 		}
 
-		case Op::SetLocal:
+		CASE(SetLocal):
 		{
 			auto stackOffset = readUint32();
 			m_callStack.top().values[stackOffset] = m_stack.peek(0);
-			break;
+			DISPATCH();
 		}
 
-		case Op::CreateGlobal:
+		CASE(CreateGlobal):
 		{
 			// Don't know if I should allow redeclaration of global in a language focused on being used as a REPL.
-			auto name = m_stack.peek(0).asObj()->asString();
-			auto& value = m_stack.peek(1);
-			bool doesNotAlreadyExist = m_globals->set(name, value);
-			if (doesNotAlreadyExist == false)
+			auto& slot = m_globals->slot(readUint32());
+			if (slot.isDefined)
 			{
-				TRY(throwErrorWithMsg(m_nameErrorType, "redeclaration of '%s'", name->chars));
+				TRY(throwErrorWithMsg(m_nameErrorType, "redeclaration of '%s'", slot.name->chars));
 			}
+			slot.value = m_stack.peek(0);
+			slot.isDefined = true;
 			m_stack.pop();
-			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::GetGlobal:
+		CASE(GetGlobal):
 		{
-			auto name = m_stack.peek(0).asObj()->asString();
-			const auto result = getGlobal(name);
+			auto& slot = m_globals->slot(readUint32());
+			if (slot.isDefined)
+			{
+				TRY_PUSH(slot.value);
+				DISPATCH();
+			}
+			const auto result = getBuiltin(slot);
 			TRY_WITH_VALUE(result);
-			m_stack.pop();
 			TRY_PUSH(result.value);
-			break;
+			DISPATCH();
 		}
 
-		case Op::SetGlobal:
+		CASE(SetGlobal):
 		{
-			auto name = m_stack.peek(0).asObj()->asString();
-			auto& value = m_stack.peek(1);
-			TRY(setGlobal(name, value));
-			m_stack.pop();
-			break;
+			auto& slot = m_globals->slot(readUint32());
+			if (slot.isDefined == false)
+			{
+				TRY(throwErrorWithMsg(m_nameErrorType, "'%s' is not defined", slot.name->chars));
+			}
+			slot.value = m_stack.peek(0);
+			DISPATCH();
 		}
 
-		case Op::GetUpvalue:
+		CASE(GetUpvalue):
 		{
 			const auto index = readUint32();
 			TRY_PUSH(*m_callStack.top().upvalues[index]->location);
-			break;
+			DISPATCH();
 		}
 
-		case Op::SetUpvalue:
+		CASE(SetUpvalue):
 		{
 			const auto index = readUint32();
 			*m_callStack.top().upvalues[index]->location = m_stack.peek(0);
-			break;
+			DISPATCH();
 		}
 
-		case Op::GetField:
+		CASE(GetField):
 		{
-			auto fieldName = m_stack.peek(0).as.obj->asString();
+			auto& cache = readInlineCache();
+			auto fieldName = m_stack.peek(0).asObj()->asString();
 			auto lhs = m_stack.peek(1);
 
-			TRY(getField(lhs, fieldName));
+			TRY(getFieldCached(cache, lhs, fieldName));
 			const auto value = m_stack.top();
 			m_stack.pop();
 			m_stack.pop();
 			m_stack.pop();
 			TRY_PUSH(value);
-			break;
+			DISPATCH();
 		}
 
-		case Op::SetField:
+		CASE(SetField):
 		{
+			auto& cache = readInlineCache();
 			auto rhs = m_stack.peek(0);
-			auto fieldName = m_stack.peek(1).as.obj->asString();
+			auto fieldName = m_stack.peek(1).asObj()->asString();
 			auto lhs = m_stack.peek(2);
-			TRY(setField(lhs, fieldName, rhs));
+			TRY(setFieldCached(cache, lhs, fieldName, rhs));
 			m_stack.pop();
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::StoreMethod:
+		CASE(StoreMethod):
 		{
 			auto methodNameValue = m_stack.peek(0);
-			ASSERT(methodNameValue.as.obj->isString());
-			auto fieldName = methodNameValue.as.obj->asString();
+			ASSERT(methodNameValue.asObj()->isString());
+			auto fieldName = methodNameValue.asObj()->asString();
 			auto classValue = m_stack.peek(2);
 			auto methodValue = m_stack.peek(1);
 
-			ASSERT(classValue.isObj() && classValue.as.obj->isClass());
-			auto class_ = classValue.as.obj->asClass();
-			class_->fields.set(fieldName, methodValue);
+			ASSERT(classValue.isObj() && classValue.asObj()->isClass());
+			auto class_ = classValue.asObj()->asClass();
+			setClassField(class_, fieldName, methodValue);
 			m_stack.pop();
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::GetIndex:
+		CASE(GetIndex):
 		{
 			auto& value = m_stack.peek(1);
 			if (auto class_ = getClass(value); class_.has_value())
 			{
-				auto getIndexFunction = class_->fields.get(m_getIndexString);
-				if (getIndexFunction.has_value() == false)
+				const auto& getIndexFunction = specialMethod(*class_, SpecialMethod::GetIndex);
+				if (getIndexFunction.isNull())
 				{
 					return fatalError("type doesn't define an index function");
 				}
-				TRY(callValue(*getIndexFunction, 2, 0));
+				TRY(callValue(getIndexFunction, 2, 0));
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::SetIndex:
+		CASE(SetIndex):
 		{
 			auto& value = m_stack.peek(2);
 			if (auto class_ = getClass(value); class_.has_value())
 			{
-				auto setIndexFunction = class_->fields.get(m_setIndexString);
-				if (setIndexFunction.has_value() == false)
+				const auto& setIndexFunction = specialMethod(*class_, SpecialMethod::SetIndex);
+				if (setIndexFunction.isNull())
 				{
 					return fatalError("type doesn't define an set index function");
 				}
-				TRY(callValue(*setIndexFunction, 3, 0));
+				TRY(callValue(setIndexFunction, 3, 0));
 			}
 			else
 			{
 				return fatalError("type doesn't define an set index function");
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::LoadNull:
+		CASE(LoadNull):
 			TRY_PUSH(Value::null());
-			break;
+			DISPATCH();
 
-		case Op::LoadTrue:
+		CASE(LoadTrue):
 			TRY_PUSH(Value(true));
-			break;
+			DISPATCH();
 
-		case Op::LoadFalse:
+		CASE(LoadFalse):
 			TRY_PUSH(Value(false));
-			break;
+			DISPATCH();
 
-		case Op::Jump:
+		CASE(Jump):
 		{
 			auto jump = readUint32();
 			m_instructionPointer += jump;
-			break;
+			DISPATCH();
 		}
 
-		case Op::JumpIfTrue:
+		CASE(JumpIfTrue):
 		{
 			const auto jump = readUint32();
 			const auto& value = m_stack.peek(0);
@@ -772,10 +1082,10 @@ Vm::Result Vm::run()
 			{
 				m_instructionPointer += jump;
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::JumpIfFalse:
+		CASE(JumpIfFalse):
 		{
 			const auto jump = readUint32();
 			const auto& value = m_stack.peek(0);
@@ -787,10 +1097,10 @@ Vm::Result Vm::run()
 			{
 				m_instructionPointer += jump;
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::JumpIfFalseAndPop:
+		CASE(JumpIfFalseAndPop):
 		{
 			const auto jump = readUint32();
 			const auto& value = m_stack.peek(0);
@@ -803,31 +1113,209 @@ Vm::Result Vm::run()
 				m_instructionPointer += jump;
 			}
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::JumpBack:
+		CASE(JumpBack):
 		{
 			const auto jump = readUint32();
 			m_instructionPointer -= jump;
-			break;
+			DISPATCH();
 		}
 
-		case Op::Call:
+		CASE(Call):
 		{
 			const auto argCount = readUint32();
 			const auto& calleValue = m_stack.peek(argCount);
 			TRY(callValue(calleValue, argCount, 1 /* pop callValue */));
-			break;
+			DISPATCH();
+		}
+
+		CASE(TailCall):
+		{
+			const auto argCount = readUint32();
+			auto& frame = m_callStack.top();
+			const auto calle = m_stack.peek(argCount);
+
+			ObjFunction* function = nullptr;
+			ObjClosure* closure = nullptr;
+			// The callers of initializers expect the instance to be returned and the script frame is popped differently.
+			if (calle.isObj() && (frame.isInitializer == false) && (m_callStack.size() > 1))
+			{
+				const auto obj = calle.asObj();
+				if (obj->isFunction())
+				{
+					function = obj->asFunction();
+				}
+				// The closure has to stay on the stack so it isn't collected, because the frame only stores its
+				// function. Its slot is the slot of the current calle.
+				else if (obj->isClosure() && (frame.numberOfValuesToPopOffExceptArgs >= 1))
+				{
+					closure = obj->asClosure();
+					function = closure->function;
+				}
+			}
+
+			if (function == nullptr)
+			{
+				// Executes the Return following this instruction after the call.
+				TRY(callValue(calle, argCount, 1 /* pop callValue */));
+				DISPATCH();
+			}
+
+			if (argCount != function->argCount)
+			{
+				return fatalError("expected %d arguments but got %d", function->argCount, argCount);
+			}
+			// The compiler doesn't emit tail calls inside try blocks, because the handlers are found using the frame.
+
+			closeUpvalues(frame.values);
+			const auto args = m_stack.topPtr - argCount;
+			std::copy(args, m_stack.topPtr, frame.values);
+			m_stack.topPtr = frame.values + argCount;
+			if (closure != nullptr)
+			{
+				frame.values[-1] = calle;
+				frame.upvalues = closure->upvalues;
+			}
+			frame.callable = function;
+			m_globals = function->globals;
+			m_constants = function->byteCode.constants.data();
+#ifdef VOXL_DEBUG_PRINT_INLINE_CACHE_STATS
+			if (function->byteCode.isPrepared == false)
+				m_functionsWithInlineCaches.push_back(function);
+#endif
+			m_instructionPointer = function->byteCode.executableCode();
+			// The new function might need more space than the previous one.
+			TRY_RESERVE_STACK(function->byteCode.maxStackSize + FRAME_STACK_SLACK);
+			DISPATCH();
 		}
 
-		case Op::PopStack:
+		CASE(Invoke):
+		{
+			auto& cache = readInlineCache();
+			const auto methodName = m_constants[readUint32()].asObj()->asString();
+			const auto argCount = readUint32();
+			TRY(invoke(cache, methodName, argCount));
+			DISPATCH();
+		}
+
+		CASE(GetIter):
+		{
+			const auto& iterable = m_stack.peek(0);
+			if (iterable.isObj() && iterable.asObj()->isNativeInstance())
+			{
+				const auto instance = iterable.asObj()->asNativeInstance();
+				// Iterated by ForIter without creating an iterator. Subclasses might override $iter(), so only instances
+				// of the builtin classes are.
+				if ((instance->class_ == m_listType) || (instance->class_ == m_dictType) || (instance->class_ == m_rangeType))
+					DISPATCH();
+			}
+			TRY(callMethod(m_iterString, 0));
+			DISPATCH();
+		}
+
+		CASE(ForIter):
+		forIter:
+		{
+			const auto jump = readUint32();
+			const auto& iterator = m_stack.peek(1);
+			auto& index = m_stack.peek(0);
+			if (iterator.isObj() && iterator.asObj()->isNativeInstance())
+			{
+				const auto instance = iterator.asObj()->asNativeInstance();
+				if (instance->class_ == m_listType)
+				{
+					const auto list = static_cast<List*>(instance);
+					const auto i = index.asInt();
+					if (static_cast<size_t>(i) >= list->size)
+					{
+						m_instructionPointer += jump;
+						DISPATCH();
+					}
+					index = Value::intNum(i + 1);
+					TRY_PUSH(list->data[i]);
+					DISPATCH();
+				}
+				if (instance->class_ == m_dictType)
+				{
+					auto position = index.asInt();
+					const auto key = static_cast<Dict*>(instance)->nextKey(position);
+					if (key == nullptr)
+					{
+						m_instructionPointer += jump;
+						DISPATCH();
+					}
+					index = Value::intNum(position);
+					TRY_PUSH(*key);
+					DISPATCH();
+				}
+				if (instance->class_ == m_rangeType)
+				{
+					const auto range = static_cast<Range*>(instance);
+					const auto item = range->start + index.asInt();
+					if (item >= range->end)
+					{
+						m_instructionPointer += jump;
+						DISPATCH();
+					}
+					index = Value::intNum(index.asInt() + 1);
+					TRY_PUSH(Value::intNum(item, *m_allocator));
+					DISPATCH();
+				}
+			}
+
+			// The instruction pointer already points past this instruction, so if $next() throws StopIteration
+			// the exception handler of this instruction ends the loop.
+			const auto receiver = iterator;
+			TRY_PUSH(receiver);
+			TRY(callMethod(m_nextString, 0));
+			DISPATCH();
+		}
+
+		CASE(ForRangeBegin):
+		{
+			const auto jump = readUint32();
+			const auto& calle = m_stack.peek(2);
+			const auto& start = m_stack.peek(1);
+			const auto& end = m_stack.peek(0);
+			// Range might be shadowed so this can only be checked at runtime.
+			if (calle.isObj() && (calle.asObj() == m_rangeType) && start.isInt() && end.isInt())
+			{
+				m_stack.peek(2) = end;
+				m_stack.pop();
+				m_instructionPointer += jump;
+			}
+			DISPATCH();
+		}
+
+		CASE(ForRange):
+		{
+			const auto& end = m_stack.peek(1);
+			// The loop doesn't iterate over the builtin Range.
+			if (end.isInt() == false)
+				goto forIter;
+
+			const auto jump = readUint32();
+			auto& counter = m_stack.peek(0);
+			const auto item = counter.asInt();
+			if (item >= end.asInt())
+			{
+				m_instructionPointer += jump;
+				DISPATCH();
+			}
+			counter = Value::intNum(item + 1, *m_allocator);
+			TRY_PUSH(Value::intNum(item, *m_allocator));
+			DISPATCH();
+		}
+
+		CASE(PopStack):
 		{
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::Return:
+		CASE(Return):
 		{
 			if (m_callStack.size() == 1)
 			{
@@ -841,28 +1329,7 @@ Vm::Result Vm::run()
 				const auto& result = frame.isInitializer ? *frame.values : m_stack.peek(0);
 				m_stack.topPtr = frame.values - frame.numberOfValuesToPopOffExceptArgs;
 
-				auto isLocal = [this, &frame](ObjUpvalue* upvalue)
-				{
-					return upvalue->location >= frame.values;
-				};
-
-				for (;;)
-				{
-					auto it = std::find_if(m_openUpvalues.begin(), m_openUpvalues.end(), isLocal);
-					if (it == m_openUpvalues.end())
-					{
-						break;
-					}
-					auto upvalue = *it;
-					upvalue->value = *upvalue->location;
-					upvalue->location = &upvalue->value;
-					m_openUpvalues.erase(it);
-				}
-
-				while ((m_exceptionHandlers.isEmpty() == false) && (m_exceptionHandlers.top().callFrame == &frame))
-				{
-					m_exceptionHandlers.pop();
-				}
+				closeUpvalues(frame.values);
 
 				popCallStack();
 
@@ -872,46 +1339,30 @@ Vm::Result Vm::run()
 				if ((callable == nullptr) || callable->isNativeFunction())
 					return Result::ok();
 			}
-			break;
+			DISPATCH();
 		}
 
-		case Op::CreateClass:
+		CASE(CreateClass):
 		{
 			auto nameValue = m_stack.peek(0);
 
-			ASSERT((nameValue.type == ValueType::Obj) && (nameValue.as.obj->isString()));
-			auto name = nameValue.as.obj->asString();
+			ASSERT((nameValue.isObj()) && (nameValue.asObj()->isString()));
+			auto name = nameValue.asObj()->asString();
 			auto class_ = m_allocator->allocateClass(name);
 			m_stack.pop();
 			TRY_PUSH(Value(class_));
-			break;
-		}
-
-		case Op::TryBegin:
-		{
-			const auto jump = readUint32();
-			TRY_PUSH_EXCEPTION_HANDLER();
-			auto& handler = m_exceptionHandlers.top();
-			auto& frame = m_callStack.top();
-			handler.callFrame = &frame;
-			handler.handlerCodeLocation = m_instructionPointer + jump;
-			handler.stackTopPtrBeforeTry = m_stack.topPtr;
-			break;
+			DISPATCH();
 		}
 
-		case Op::TryEnd:
-			m_exceptionHandlers.pop();
-			break;
-
-		case Op::Throw:
+		CASE(Throw):
 		{
 			TRY(throwValue(m_stack.peek(0)));
-			break;
+			DISPATCH();
 		}
 
-		case Op::Closure:
+		CASE(Closure):
 		{
-			auto function = m_stack.peek(0).as.obj->asFunction();
+			auto function = m_stack.peek(0).asObj()->asFunction();
 			auto closure = m_allocator->allocateClosure(function);
 			// Setting the upvalue count to 0 so if the GC runs while upvalues are allocated it 
 			// doesn't try to add unititalized pointers.
@@ -929,9 +1380,7 @@ Vm::Result Vm::run()
 
 				if (isLocal)
 				{
-					auto upvalue = m_allocator->allocateUpvalue(m_callStack.top().values + index);
-					m_openUpvalues.push_back(upvalue);
-					closure->upvalues[i] = upvalue;
+					closure->upvalues[i] = captureUpvalue(m_callStack.top().values + index);
 				}
 				else
 				{
@@ -939,93 +1388,85 @@ Vm::Result Vm::run()
 				}
 			}
 			closure->upvalueCount = function->upvalueCount;
-			break;
+			DISPATCH();
 		}
 
-		case Op::CloseUpvalue:
+		CASE(CloseUpvalue):
 		{
 			const auto index = readUint8();
-			for (auto it = m_openUpvalues.begin(); it != m_openUpvalues.end(); it++)
+			const auto local = m_callStack.top().values + index;
+			// The locals of a scope aren't closed in order so only the upvalue of this local is closed.
+			auto previous = &m_openUpvalues;
+			while ((*previous != nullptr) && ((*previous)->location > local))
 			{
-				auto& upvalue = *it;
-				auto& local = m_callStack.top().values[index];
-				if (upvalue->location == &local)
-				{
-					upvalue->value = local;
-					upvalue->location = &upvalue->value;
-					m_openUpvalues.erase(it);
-					break;
-				}
+				previous = &(*previous)->next;
 			}
-			break;
+			if ((*previous != nullptr) && ((*previous)->location == local))
+			{
+				auto upvalue = *previous;
+				*previous = upvalue->next;
+				upvalue->value = *local;
+				upvalue->location = &upvalue->value;
+			}
+			DISPATCH();
 		}
 
-		case Op::MatchClass:
+		CASE(MatchClass):
 		{
-			const auto& class_ = m_stack.peek(0).as.obj->asClass();
+			const auto& class_ = m_stack.peek(0).asObj()->asClass();
 			const auto& value = m_stack.peek(1);
-			auto valueClass = getClass(value);
-			bool matched = false;
-			while (valueClass.has_value())
-			{
-				if (&*valueClass == class_)
-				{
-					matched = true;
-					break;
-				}
-				valueClass = valueClass->superclass;
-			}
-			m_stack.top() = Value(matched);
-			break;
+			const auto valueClass = getClass(value);
+			m_stack.top() = Value(valueClass.has_value() && valueClass->isSubclassOf(*class_));
+			DISPATCH();
 		}
 
-		case Op::Import:
+		CASE(Import):
 		{
 			auto filename = m_stack.peek(0).asObj()->asString();
 			m_stack.pop();
 			TRY(importModule(filename));
-			break;
+			DISPATCH();
 		}
 
-		case Op::ModuleSetLoaded:
+		CASE(ModuleSetLoaded):
 		{
 			auto module = m_stack.peek(0).asObj()->asModule();
 			module->isLoaded = true;
-			break;
+			DISPATCH();
 		}
 
-		case Op::ModuleImportAllToGlobalNamespace:
+		CASE(ModuleImportAllToGlobalNamespace):
 		{
 			auto module = m_stack.peek(0).asObj()->asModule();
 			TRY(importAllFromModule(module));
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::CloneTop:
+		CASE(CloneTop):
 		{
 			TRY_PUSH(m_stack.peek(0));
-			break;
+			DISPATCH();
 		}
 
-		case Op::CloneTopTwo:
+		CASE(CloneTopTwo):
 		{
 			ASSERT(m_stack.size() >= 2);
 			TRY_PUSH(m_stack.peek(1));
 			TRY_PUSH(m_stack.peek(1));
-			break;
+			DISPATCH();
 		}
 
-		case Op::FinallyBegin:
+		CASE(FinallyBegin):
 			m_finallyBlockDepth++;
-			break;
+			DISPATCH();
 
-		case Op::FinallyEnd:
+		CASE(FinallyEnd):
 			ASSERT(m_finallyBlockDepth != 0);
 			m_finallyBlockDepth--;
-			break;
+			DISPATCH();
 
-		case Op::Inherit:
+		CASE(Inherit):
 		{
 			auto class_ = m_stack.peek(1).asObj()->asClass();
 			auto& superclassValue = m_stack.peek(0);
@@ -1034,7 +1475,7 @@ Vm::Result Vm::run()
 				TRY(throwTypeErrorExpectedFound(m_typeType, superclassValue));
 			}
 			auto superclass = superclassValue.asObj()->asClass();
-			class_->superclass = *superclass;
+			inherit(class_, superclass);
 			if (superclass->isNative())
 			{
 				class_->mark = superclass->mark;
@@ -1043,18 +1484,18 @@ Vm::Result Vm::run()
 			}
 
 			m_stack.pop();
-			break;
+			DISPATCH();
 		}
 
-		case Op::CreateList:
+		CASE(CreateList):
 		{
 			auto list = m_allocator->allocateNativeInstance(m_listType);
 			List::init(static_cast<List*>(list));
 			TRY_PUSH(Value(list));
-			break;
+			DISPATCH();
 		}
 
-		case Op::ListPush:
+		CASE(ListPush):
 		{
 			auto& listValue = m_stack.peek(1);
 			const auto& newElement = m_stack.peek(0);
@@ -1066,28 +1507,31 @@ Vm::Result Vm::run()
 			const auto list = static_cast<List*>(listInstance);
 			m_stack.pop();
 			list->push(newElement);
-			break;
+			DISPATCH();
 		}
 
-		case Op::CreateDict:
+		CASE(CreateDict):
 		{
 			auto dict = m_allocator->allocateNativeInstance(m_dictType);
 			Dict::init(static_cast<Dict*>(dict));
 			TRY_PUSH(Value(dict));
-			break;
+			DISPATCH();
 		}
 
-		case Op::DictSet:
+		CASE(DictSet):
 		{
 			const auto dict = m_stack.peek(2);
 			auto insert = m_dictType->fields.get(m_setIndexString);
 			ASSERT(insert.has_value());
 			TRY(callValue(*insert, 3, 0));
 			m_stack.top() = dict;
-			break;
+			DISPATCH();
 		}
 
 		default:
+	#ifdef VOXL_USE_COMPUTED_GOTO
+		invalidOp:
+	#endif
 			ASSERT_NOT_REACHED();
 			return Result::fatal();
 		}
@@ -1095,6 +1539,11 @@ Vm::Result Vm::run()
 		switchBreak:;
 	}
 }
+#ifdef VOXL_USE_COMPUTED_GOTO
+	#pragma GCC diagnostic pop
+#endif
+#undef CASE
+#undef DISPATCH
 #undef TRY
 #define TRY TRY_OUTSIDE_RUN
 #undef TRY_WITH_VALUE
@@ -1102,7 +1551,7 @@ Vm::Result Vm::run()
 
 void Vm::defineNativeFunction(std::string_view name, NativeFunction function, int argCount)
 {
-	auto nameObj = m_allocator->allocateStringConstant(name).value;
+	auto nameObj = m_allocator->allocateStringConstant(name);
 	auto functionObj = m_allocator->allocateForeignFunction(nameObj, function, argCount, &m_builtins, nullptr);
 	m_builtins.set(nameObj, Value(functionObj));
 }
@@ -1114,7 +1563,7 @@ void Vm::createModule(std::string_view name, NativeFunction moduleMain, void* da
 
 uint8_t Vm::readUint8()
 {
-	uint8_t value = *m_instructionPointer;
+	uint8_t value = static_cast<uint8_t>(*m_instructionPointer);
 	m_instructionPointer++;
 	return value;
 }
@@ -1132,20 +1581,50 @@ Vm::Result Vm::fatalError(const char* format, ...)
 	return Result::fatal();
 }
 
+bool Vm::growStack(size_t freeSpace)
+{
+	const auto oldData = m_stack.data();
+	if (m_stack.grow(freeSpace) == false)
+		return false;
+
+	const auto newData = m_stack.data();
+	const auto relocate = [oldData, newData](Value* pointer) -> Value*
+	{
+		return newData + (pointer - oldData);
+	};
+	for (auto& frame : m_callStack)
+	{
+		// Dummy frames don't have values.
+		if (frame.values != nullptr)
+			frame.values = relocate(frame.values);
+	}
+	for (auto upvalue = m_openUpvalues; upvalue != nullptr; upvalue = upvalue->next)
+	{
+		upvalue->location = relocate(upvalue->location);
+	}
+	return true;
+}
+
 Vm::Result Vm::callObjFunction(ObjFunction* function, int argCount, int numberOfValuesToPopOffExceptArgs, bool isInitializer)
 {
 	if (argCount != function->argCount)
 	{
 		return fatalError("expected %d arguments but got %d", function->argCount, argCount);
 	}
+	TRY_RESERVE_STACK(function->byteCode.maxStackSize + FRAME_STACK_SLACK);
 	if (m_callStack.isEmpty() == false)
 		m_callStack.top().instructionPointerBeforeCall = m_instructionPointer;
 	TRY_PUSH_CALL_STACK();
 	auto& frame = m_callStack.top();
-	m_instructionPointer = function->byteCode.code.data();
+#ifdef VOXL_DEBUG_PRINT_INLINE_CACHE_STATS
+	if (function->byteCode.isPrepared == false)
+		m_functionsWithInlineCaches.push_back(function);
+#endif
+	m_instructionPointer = function->byteCode.executableCode();
 	frame.values = m_stack.topPtr - argCount;
 	frame.callable = function;
 	m_globals = function->globals;
+	m_constants = function->byteCode.constants.data();
 	frame.numberOfValuesToPopOffExceptArgs = numberOfValuesToPopOffExceptArgs;
 	frame.isInitializer = isInitializer;
 	return Result::ok();
@@ -1157,7 +1636,7 @@ Vm::Result Vm::callValue(Value value, int argCount, int numberOfValuesToPopOffEx
 	{
 		return fatalError("type is not calable\n");
 	}
-	auto obj = value.as.obj;
+	auto obj = value.asObj();
 	switch (obj->type)
 	{
 		case ObjType::Function:
@@ -1183,20 +1662,25 @@ Vm::Result Vm::callValue(Value value, int argCount, int numberOfValuesToPopOffEx
 				return fatalError("expected %d arguments but got %d", function->argCount, argCount);
 			} 
 			// TODO Maybe put the common parts into a function idk.
+			TRY_RESERVE_STACK(FRAME_STACK_SPACE);
 			if (m_callStack.isEmpty() == false)
 				m_callStack.top().instructionPointerBeforeCall = m_instructionPointer;
 			TRY_PUSH_CALL_STACK();
 			auto& frame = m_callStack.top();
 			frame.callable = function;
 			frame.isInitializer = isInitializer;
+			frame.values = m_stack.topPtr - argCount;
 			m_globals = function->globals;
 			try
 			{
-				const auto args = m_stack.topPtr - argCount;
-				Context context(args, argCount, *m_allocator, *this, function->context);
+				// The stack might grow during the call.
+				const auto argsStackIndex = m_stack.size() - static_cast<size_t>(argCount);
+				// Frees the handles of the LocalValues created by the function.
+				Allocator::HandleScope handleScope(*m_allocator);
+				Context context(m_stack.topPtr - argCount, argCount, *m_allocator, *this, function->context);
 				const auto result = function->function(context);
 				m_stack.popN(numberOfValuesToPopOffExceptArgs + static_cast<size_t>(argCount));
-				TRY_PUSH(isInitializer ? args[0] : result.value);
+				TRY_PUSH(isInitializer ? m_stack[argsStackIndex] : result.value);
 				popCallStack();
 			}
 			catch (const NativeException& exception)
@@ -1234,7 +1718,7 @@ Vm::Result Vm::callValue(Value value, int argCount, int numberOfValuesToPopOffEx
 					returnFromSpecialConstructor(args[0]);
 				else if (args[0].isFloat())
 					// TODO: Don't know what rounding to use.
-					returnFromSpecialConstructor(Value::intNum(static_cast<Int>(args[0].asFloat())));
+					returnFromSpecialConstructor(Value::intNum(static_cast<Int>(args[0].asFloat()), *m_allocator));
 				else
 					return fatalError("expected number got b");
 			}
@@ -1326,20 +1810,13 @@ std::optional<Value> Vm::atField(Value& value, ObjString* fieldName)
 		const auto obj = value.asObj();
 		if (obj->isInstance())
 		{
-			if (const auto field = obj->asInstance()->fields.get(fieldName); field.has_value())
+			if (const auto field = atInstanceField(obj->asInstance(), fieldName); field.has_value())
 				return *field;
 		}
 		else if (obj->isClass())
 		{
-			std::optional<ObjClass&> class_(*obj->asClass());
-			while (class_.has_value())
-			{
-				auto method = class_->fields.get(fieldName);
-				if (method.has_value())
-					return *method;
-
-				class_ = class_->superclass;
-			}
+			if (const auto field = obj->asClass()->resolvedFields.get(fieldName); field.has_value())
+				return *field;
 			return std::nullopt;
 		}
 		else if (obj->isModule())
@@ -1356,7 +1833,7 @@ std::optional<Value> Vm::atField(Value& value, ObjString* fieldName)
 	}
 	
 	auto method = getMethod(value, fieldName);
-	if (method->isObj() == false)
+	if ((method.has_value() == false) || (method->isObj() == false))
 		return std::nullopt;
 
 	auto methodObj = method->asObj();
@@ -1366,21 +1843,68 @@ std::optional<Value> Vm::atField(Value& value, ObjString* fieldName)
 	return Value(m_allocator->allocateBoundFunction(methodObj, value));
 }
 
+const Value& Vm::specialMethod(ObjClass& class_, SpecialMethod method)
+{
+	if (class_.specialMethodsVersion != class_.version)
+	{
+		for (size_t i = 0; i < ObjClass::SPECIAL_METHOD_COUNT; i++)
+		{
+			const auto found = class_.resolvedFields.get(m_specialMethodNames[i]);
+			class_.specialMethods[i] = found.has_value() ? *found : Value::null();
+		}
+		class_.specialMethodsVersion = class_.version;
+	}
+	return class_.specialMethods[static_cast<size_t>(method)];
+}
+
 std::optional<Value> Vm::getMethod(Value& value, ObjString* methodName)
 {
 	// TODO: Maybe have a seperate hash table for method and fields of a class. Method could only be added using Impl.
 	// Could return by reference instead of value.
 	// This also prevents overriding methods like constructors.
 	auto class_ = getClass(value);
-	while (class_.has_value())
+	if (class_.has_value() == false)
+		return std::nullopt;
+	if (const auto method = class_->resolvedFields.get(methodName); method.has_value())
+		return *method;
+	return std::nullopt;
+}
+
+void Vm::setClassField(ObjClass* class_, ObjString* fieldName, const Value& value)
+{
+	class_->fields.set(fieldName, value);
+	setResolvedField(class_, fieldName, value);
+}
+
+void Vm::setResolvedField(ObjClass* class_, ObjString* fieldName, const Value& value)
+{
+	class_->resolvedFields.set(fieldName, value);
+	class_->version++;
+	for (const auto subclass : class_->subclasses)
 	{
-		auto method = class_->fields.get(methodName);
-		if (method.has_value())
-			return *method;
+		// The field is overridden in the subclass and its subclasses.
+		if (subclass->fields.get(fieldName).has_value())
+			continue;
+		setResolvedField(subclass, fieldName, value);
+	}
+}
 
-		class_ = class_->superclass;
+void Vm::inherit(ObjClass* class_, ObjClass* superclass)
+{
+	// The inherited fields of the previous superclass would need to be removed and the displays of the subclasses
+	// would need to be rebuilt.
+	ASSERT(class_->superclass.has_value() == false);
+	ASSERT(class_->subclasses.empty());
+	class_->superclass = *superclass;
+	superclass->subclasses.push_back(class_);
+	class_->display = superclass->display;
+	class_->display.push_back(class_);
+	for (const auto& [fieldName, value] : superclass->resolvedFields)
+	{
+		if (class_->fields.get(fieldName).has_value() == false)
+			setResolvedField(class_, fieldName, value);
 	}
-	return std::nullopt;
+	class_->version++;
 }
 
 Vm::Result Vm::setField(const Value& lhs, ObjString* fieldName, const Value& rhs)
@@ -1388,21 +1912,279 @@ Vm::Result Vm::setField(const Value& lhs, ObjString* fieldName, const Value& rhs
 	if ((lhs.isObj() == false))
 		return fatalError("cannot use field access on this type");
 
-	auto obj = lhs.as.obj;
+	auto obj = lhs.asObj();
 	if (obj->isInstance())
 	{
-		obj->asInstance()->fields.set(fieldName, rhs);
+		setInstanceField(obj->asInstance(), fieldName, rhs);
 		return Result::ok();
 	}
 	else if (obj->isClass())
 	{
-		obj->asClass()->fields.set(fieldName, rhs);
+		setClassField(obj->asClass(), fieldName, rhs);
 		return Result::ok();
 	}
 
 	return fatalError("cannot use field access on this type");
 }
 
+std::optional<Value&> Vm::atInstanceField(ObjInstance* instance, const ObjString* fieldName)
+{
+	if (instance->shape == nullptr)
+		return instance->fields->get(fieldName);
+
+	const auto index = instance->shape->fieldIndices.get(fieldName);
+	if (index.has_value() == false)
+		return std::nullopt;
+	return instance->slots[index->asInt()];
+}
+
+void Vm::setInstanceField(ObjInstance* instance, ObjString* fieldName, const Value& value)
+{
+	if (instance->shape == nullptr)
+	{
+		instance->fields->set(fieldName, value);
+		return;
+	}
+
+	const auto shape = instance->shape;
+	if (const auto index = shape->fieldIndices.get(fieldName); index.has_value())
+	{
+		instance->slots[index->asInt()] = value;
+		return;
+	}
+
+	ObjShape* newShape;
+	if (const auto transition = shape->transitions.get(fieldName); transition.has_value())
+	{
+		newShape = transition->asObj()->asShape();
+	}
+	else if ((shape->fieldCount >= ObjShape::MAX_FIELD_COUNT) || (shape->transitions.size() >= ObjShape::MAX_TRANSITION_COUNT))
+	{
+		convertToDictionaryMode(instance);
+		instance->fields->set(fieldName, value);
+		return;
+	}
+	else
+	{
+		newShape = m_allocator->allocateShape(shape, fieldName);
+		shape->transitions.set(fieldName, Value(newShape));
+	}
+
+	if (newShape->fieldCount > instance->slotCapacity)
+	{
+		const auto newCapacity = instance->slotCapacity * 2;
+		const auto newSlots = reinterpret_cast<Value*>(::operator new(sizeof(Value) * newCapacity));
+		memcpy(newSlots, instance->slots, sizeof(Value) * shape->fieldCount);
+		if (instance->slots != instance->inlineSlots)
+			::operator delete(instance->slots);
+		instance->slots = newSlots;
+		instance->slotCapacity = newCapacity;
+	}
+	instance->slots[shape->fieldCount] = value;
+	instance->shape = newShape;
+}
+
+void Vm::convertToDictionaryMode(ObjInstance* instance)
+{
+	const auto fields = new HashTable();
+	for (const auto& [fieldName, index] : instance->shape->fieldIndices)
+	{
+		fields->set(fieldName, instance->slots[index.asInt()]);
+	}
+	if (instance->slots != instance->inlineSlots)
+		::operator delete(instance->slots);
+	instance->fields = fields;
+	instance->slotCapacity = 0;
+	instance->shape = nullptr;
+}
+
+InlineCache& Vm::readInlineCache()
+{
+	const auto index = readUint32();
+	return m_callStack.top().callable->asFunction()->byteCode.inlineCaches[index];
+}
+
+const void* Vm::inlineCacheKey(const Value& value)
+{
+	if (value.isObj())
+	{
+		const auto obj = value.asObj();
+		// Dictionary mode instances return nullptr.
+		if (obj->isInstance())
+			return obj->asInstance()->shape;
+		// Class and module fields are accessed directly by atField.
+		if (obj->isClass() || obj->isModule())
+			return nullptr;
+	}
+	const auto class_ = getClass(value);
+	return class_.has_value() ? &*class_ : nullptr;
+}
+
+// Returns the entry with the key if it isn't outdated.
+static const InlineCacheEntry* findValidEntry(const InlineCache& cache, const void* key)
+{
+	const auto entry = cache.find(key);
+	if (entry == nullptr)
+		return nullptr;
+	const auto isOutdated = (entry->kind == InlineCacheEntry::Kind::Method) && (entry->class_->version != entry->classVersion);
+	return isOutdated ? nullptr : entry;
+}
+
+Vm::Result Vm::getFieldCached(InlineCache& cache, Value& value, ObjString* fieldName)
+{
+	const auto key = inlineCacheKey(value);
+	if (key == nullptr)
+		return getField(value, fieldName);
+
+	if (const auto entry = findValidEntry(cache, key); entry != nullptr)
+	{
+		cache.hits++;
+		if (entry->kind == InlineCacheEntry::Kind::Slot)
+		{
+			TRY_PUSH(value.asObj()->asInstance()->slots[entry->slot]);
+		}
+		else
+		{
+			TRY_PUSH(Value(m_allocator->allocateBoundFunction(entry->method.asObj(), value)));
+		}
+		return Result::ok();
+	}
+
+	cache.misses++;
+	TRY(getField(value, fieldName));
+
+	if (value.isObj() && value.asObj()->isInstance())
+	{
+		const auto shape = value.asObj()->asInstance()->shape;
+		if (const auto index = shape->fieldIndices.get(fieldName); index.has_value())
+		{
+			cache.add(InlineCacheEntry{ key, InlineCacheEntry::Kind::Slot, static_cast<uint32_t>(index->asInt()), Value::null(), nullptr, nullptr, 0 });
+			return Result::ok();
+		}
+	}
+	if (const auto method = getMethod(value, fieldName); method.has_value() && method->isObj() && method->asObj()->canBeBound())
+	{
+		const auto class_ = &*getClass(value);
+		cache.add(InlineCacheEntry{ key, InlineCacheEntry::Kind::Method, 0, *method, nullptr, class_, class_->version });
+	}
+	return Result::ok();
+}
+
+Vm::Result Vm::setFieldCached(InlineCache& cache, const Value& lhs, ObjString* fieldName, const Value& rhs)
+{
+	if ((lhs.isObj() == false) || (lhs.asObj()->isInstance() == false) || (lhs.asObj()->asInstance()->shape == nullptr))
+		return setField(lhs, fieldName, rhs);
+
+	const auto instance = lhs.asObj()->asInstance();
+	const auto shape = instance->shape;
+	if (const auto entry = cache.find(shape); entry != nullptr)
+	{
+		if (entry->kind == InlineCacheEntry::Kind::Slot)
+		{
+			cache.hits++;
+			instance->slots[entry->slot] = rhs;
+			return Result::ok();
+		}
+		// If the slots need to grow use the slow path.
+		else if (entry->slot < instance->slotCapacity)
+		{
+			cache.hits++;
+			instance->slots[entry->slot] = rhs;
+			instance->shape = entry->newShape;
+			return Result::ok();
+		}
+	}
+
+	cache.misses++;
+	setInstanceField(instance, fieldName, rhs);
+	if (instance->shape == shape)
+	{
+		const auto index = shape->fieldIndices.get(fieldName);
+		cache.add(InlineCacheEntry{ shape, InlineCacheEntry::Kind::Slot, static_cast<uint32_t>(index->asInt()), Value::null(), nullptr, nullptr, 0 });
+	}
+	else if ((instance->shape != nullptr) && (cache.find(shape) == nullptr))
+	{
+		cache.add(InlineCacheEntry{ 
+			shape, InlineCacheEntry::Kind::Transition, static_cast<uint32_t>(shape->fieldCount), Value::null(), instance->shape, nullptr, 0 });
+	}
+	return Result::ok();
+}
+
+Vm::Result Vm::invoke(InlineCache& cache, ObjString* methodName, int argCount)
+{
+	auto receiver = m_stack.peek(argCount);
+	const auto key = inlineCacheKey(receiver);
+	if (key != nullptr)
+	{
+		if (const auto entry = findValidEntry(cache, key); entry != nullptr)
+		{
+			cache.hits++;
+			if (entry->kind == InlineCacheEntry::Kind::Slot)
+			{
+				const auto field = receiver.asObj()->asInstance()->slots[entry->slot];
+				m_stack.peek(argCount) = field;
+				return callValue(field, argCount, 1);
+			}
+			// The receiver is already in place of the first argument.
+			return callValue(entry->method, argCount + 1, 0);
+		}
+
+		cache.misses++;
+		if (receiver.isObj() && receiver.asObj()->isInstance())
+		{
+			const auto instance = receiver.asObj()->asInstance();
+			if (const auto index = instance->shape->fieldIndices.get(methodName); index.has_value())
+			{
+				const auto slot = static_cast<uint32_t>(index->asInt());
+				cache.add(InlineCacheEntry{ key, InlineCacheEntry::Kind::Slot, slot, Value::null(), nullptr, nullptr, 0 });
+				const auto field = instance->slots[slot];
+				m_stack.peek(argCount) = field;
+				return callValue(field, argCount, 1);
+			}
+		}
+		if (const auto method = getMethod(receiver, methodName);
+			method.has_value() && method->isObj() && method->asObj()->canBeBound())
+		{
+			const auto class_ = &*getClass(receiver);
+			cache.add(InlineCacheEntry{ key, InlineCacheEntry::Kind::Method, 0, *method, nullptr, class_, class_->version });
+			return callValue(*method, argCount + 1, 0);
+		}
+	}
+
+	// Things like calling functions stored inside modules use the same path as GetField followed by Call.
+	TRY(getField(receiver, methodName));
+	const auto calle = m_stack.top();
+	m_stack.pop();
+	m_stack.peek(argCount) = calle;
+	return callValue(calle, argCount, 1);
+}
+
+Vm::Result Vm::callMethod(ObjString* methodName, int argCount)
+{
+	auto receiver = m_stack.peek(argCount);
+	if (receiver.isObj() && receiver.asObj()->isInstance())
+	{
+		if (const auto field = atInstanceField(receiver.asObj()->asInstance(), methodName); field.has_value())
+		{
+			const auto calle = *field;
+			m_stack.peek(argCount) = calle;
+			return callValue(calle, argCount, 1);
+		}
+	}
+	if (const auto method = getMethod(receiver, methodName);
+		method.has_value() && method->isObj() && method->asObj()->canBeBound())
+	{
+		// The receiver is already in place of the first argument.
+		return callValue(*method, argCount + 1, 0);
+	}
+
+	TRY(getField(receiver, methodName));
+	const auto calle = m_stack.top();
+	m_stack.pop();
+	m_stack.peek(argCount) = calle;
+	return callValue(calle, argCount, 1);
+}
+
 Vm::Result Vm::getField(Value& value, ObjString* fieldName)
 {
 	const auto field = atField(value, fieldName);
@@ -1431,7 +2213,29 @@ Vm::Result Vm::getField(Value& value, ObjString* fieldName)
 
 Vm::Result Vm::throwValue(const Value& value)
 {
-	if (m_exceptionHandlers.isEmpty())
+	// The handlers are only looked up when something is thrown so entering and leaving try blocks costs nothing.
+	const ByteCode::ExceptionHandler* handler = nullptr;
+	size_t handlerFrameIndex = 0;
+	for (auto i = m_callStack.size(); i-- > 0;)
+	{
+		const auto& frame = m_callStack[i];
+		if ((frame.callable == nullptr) || frame.callable->isNativeFunction())
+			continue;
+
+		const auto& byteCode = frame.callable->asFunction()->byteCode;
+		// The instruction pointer points past the instruction that threw or called the next frame.
+		const auto instructionPointer = (i == m_callStack.size() - 1)
+			? m_instructionPointer
+			: frame.instructionPointerBeforeCall;
+		handler = byteCode.findExceptionHandler(byteCode.offsetOf(instructionPointer - 1));
+		if (handler != nullptr)
+		{
+			handlerFrameIndex = i;
+			break;
+		}
+	}
+
+	if (handler == nullptr)
 	{
 		auto class_ = getClass(value);
 		std::optional<std::string_view> exceptionTypeName;
@@ -1439,17 +2243,18 @@ Vm::Result Vm::throwValue(const Value& value)
 		if (class_.has_value())
 		{
 			exceptionTypeName = class_->name->chars;
-			if (const auto strFunction = class_->fields.get(m_strString); strFunction.has_value())
+			if (const auto strFunction = specialMethod(*class_, SpecialMethod::Str); strFunction.isNull() == false)
 			{
 				auto arguments = value;
-				const auto result = callFromVmAndReturnValue(*strFunction, &arguments, 1);
+				const auto result = callFromVmAndReturnValue(strFunction, &arguments, 1);
 				if (result.type != ResultType::Ok)
 				{
 					m_callStack.clear();
 					return fatalError("%s.$str() failed", class_->name->chars);
 				}
-				const auto& returnValue = m_stack.top();
-				if ((returnValue.isObj() == false) || (returnValue.asObj()->asString() == false))
+				auto& returnValue = m_stack.top();
+				flattenRope(returnValue);
+				if ((returnValue.isObj() == false) || (returnValue.asObj()->isString() == false))
 				{
 					m_callStack.clear();
  					return fatalError("%s.$str() has to return values of type 'String'", class_->name->chars);
@@ -1466,23 +2271,28 @@ Vm::Result Vm::throwValue(const Value& value)
 		return fatalError("cannot throw exception from finally");
 	}
 
-	const auto& handler = m_exceptionHandlers.top();
-	auto& catchFrame = *handler.callFrame;
-
-	for (auto frame = m_callStack.crbegin(); (frame != m_callStack.crend()) && (&*frame > &catchFrame); ++frame)
+	while (m_callStack.size() - 1 > handlerFrameIndex)
 	{
-		if (frame->callable->isNativeFunction())
+		const auto& frame = m_callStack.top();
+		// The native function has to handle the exception first.
+		if ((frame.callable == nullptr) || frame.callable->isNativeFunction())
 		{
 			return Result::exception(value);
 		}
+		closeUpvalues(frame.values);
 		m_callStack.pop();
 	}
-	
-	m_stack.topPtr = handler.stackTopPtrBeforeTry;
-	m_instructionPointer = handler.handlerCodeLocation;
-	TRY_PUSH(value);
 
-	m_exceptionHandlers.pop();
+	const auto& frame = m_callStack.top();
+	const auto function = frame.callable->asFunction();
+	const auto stackTopPtrBeforeTry = frame.values + handler->stackSize;
+	// Locals above the handler's stack top are discarded so they can't be shared with upvalues created later.
+	closeUpvalues(stackTopPtrBeforeTry);
+	m_stack.topPtr = stackTopPtrBeforeTry;
+	m_instructionPointer = function->byteCode.codeAtOffset(handler->handlerOffset);
+	m_globals = function->globals;
+	m_constants = function->byteCode.constants.data();
+	TRY_PUSH(value);
 
 	return Result::exceptionHandled();
 }
@@ -1490,7 +2300,7 @@ Vm::Result Vm::throwValue(const Value& value)
 std::optional<ObjClass&> Vm::getClass(const Value& value)
 {
 	// TODO: Implement a class for every build in type. Reuse Function for different types.
-	switch (value.type)
+	switch (value.type())
 	{
 	case ValueType::Int: return *m_intType;
 	case ValueType::Float: return *m_floatType;
@@ -1502,9 +2312,10 @@ std::optional<ObjClass&> Vm::getClass(const Value& value)
 		switch (obj->type)
 		{
 		case ObjType::String: return *m_stringType;
+		case ObjType::Rope: return *m_stringType;
 		case ObjType::Class: return *m_typeType;
-		case ObjType::Instance: return *value.as.obj->asInstance()->class_;
-		case ObjType::NativeInstance: return *value.as.obj->asNativeInstance()->class_;
+		case ObjType::Instance: return *value.asObj()->asInstance()->class_;
+		case ObjType::NativeInstance: return *value.asObj()->asNativeInstance()->class_;
 		default:
 			break;
 		}
@@ -1533,14 +2344,39 @@ Vm::ResultWithValue Vm::getGlobal(ObjString* name)
 	return ResultWithValue::ok(*value);
 }
 
-Vm::Result Vm::setGlobal(ObjString* name, Value& value)
+Vm::ResultWithValue Vm::getBuiltin(Globals::Slot& slot)
 {
-	bool doesNotAlreadyExist = m_globals->set(name, value);
-	if (doesNotAlreadyExist)
+	if (slot.builtinSlotIndex == Globals::NO_SLOT)
+	{
+		if (const auto index = m_builtins.findSlotIndex(slot.name); index.has_value())
+		{
+			slot.builtinSlotIndex = *index;
+		}
+	}
+
+	if (slot.builtinSlotIndex != Globals::NO_SLOT)
 	{
-		return throwErrorWithMsg(m_nameErrorType, "'%s' is not defined", name->chars);
+		const auto& builtin = m_builtins.slot(slot.builtinSlotIndex);
+		if (builtin.isDefined)
+			return ResultWithValue::ok(builtin.value);
+	}
+	RETURN_WITHOUT_VALUE(throwErrorWithMsg(m_nameErrorType, "'%s' is not defined", slot.name->chars));
+}
+
+void Vm::debugPrintInlineCacheStats()
+{
+	for (const auto function : m_functionsWithInlineCaches)
+	{
+		const auto& caches = function->byteCode.inlineCaches;
+		for (size_t i = 0; i < caches.size(); i++)
+		{
+			std::cout
+				<< function->name->chars << " cache " << i
+				<< " hits: " << caches[i].hits
+				<< " misses: " << caches[i].misses
+				<< " entries: " << caches[i].entryCount << '\n';
+		}
 	}
-	return Result::ok();
 }
 
 void Vm::debugPrintStack()
@@ -1578,7 +2414,7 @@ Vm::Result Vm::importModule(ObjString* name)
 		m_sourceInfo->workingDirectory / std::filesystem::path(std::string_view(name->chars, name->size)));
 	if (path.has_extension() == false)
 		path.replace_extension("voxl");
-	auto pathString = m_allocator->allocateStringConstant(path.string()).value;
+	auto pathString = m_allocator->allocateStringConstant(path.string());
 	if (auto module = m_modules.get(pathString); module.has_value())
 	{
 		TRY_PUSH(*module);
@@ -1619,15 +2455,14 @@ Vm::Result Vm::importAllFromModule(ObjModule* module)
 	{
 		return fatalError("cannot use all from partially initialized module");
 	}
-	for (auto& [key, value] : module->globals)
+	// Index based loop because the module might be the current module.
+	for (size_t i = 0; i < module->globals.slots().size(); i++)
 	{
+		const auto slot = module->globals.slots()[i];
 		// TODO: maybe check if this overrides.
 		// Would require the function to return if the key already exits. Right now it sets it and returns false.
-		if (isModuleMemberPublic(key))
-			m_globals->set(key, value);
-		// TODO: Change
-		//setGlobal(key, value);
-		//setGlobal(key, value);
+		if (slot.isDefined && isModuleMemberPublic(slot.name))
+			m_globals->set(slot.name, slot.value);
 	}
 	return Result::ok();
 }
@@ -1637,6 +2472,7 @@ Vm::Result Vm::pushDummyCallFrame()
 	m_callStack.top().instructionPointerBeforeCall = m_instructionPointer;
 	TRY_PUSH_CALL_STACK();
 	m_callStack.top().instructionPointerBeforeCall = m_instructionPointer;
+	m_callStack.top().values = nullptr;
 	m_callStack.top().callable = nullptr;
 	return Result::ok();
 }
@@ -1652,6 +2488,7 @@ void Vm::popCallStack()
 		{
 		case ObjType::Function:
 			m_globals = callable->asFunction()->globals;
+			m_constants = callable->asFunction()->byteCode.constants.data();
 			break;
 
 		case ObjType::NativeFunction:
@@ -1664,6 +2501,45 @@ void Vm::popCallStack()
 	}
 }
 
+ObjUpvalue* Vm::captureUpvalue(Value* location)
+{
+	ObjUpvalue* previous = nullptr;
+	auto upvalue = m_openUpvalues;
+	while ((upvalue != nullptr) && (upvalue->location > location))
+	{
+		previous = upvalue;
+		upvalue = upvalue->next;
+	}
+	if ((upvalue != nullptr) && (upvalue->location == location))
+	{
+		return upvalue;
+	}
+
+	// The GC doesn't move objects so previous and upvalue stay valid.
+	auto created = m_allocator->allocateUpvalue(location);
+	created->next = upvalue;
+	if (previous == nullptr)
+	{
+		m_openUpvalues = created;
+	}
+	else
+	{
+		previous->next = created;
+	}
+	return created;
+}
+
+void Vm::closeUpvalues(const Value* location)
+{
+	while ((m_openUpvalues != nullptr) && (m_openUpvalues->location >= location))
+	{
+		auto upvalue = m_openUpvalues;
+		upvalue->value = *upvalue->location;
+		upvalue->location = &upvalue->value;
+		m_openUpvalues = upvalue->next;
+	}
+}
+
 bool Vm::isModuleMemberPublic(const ObjString* name)
 {
 	return (name->size > 0) && (name->chars[0] != '_');
@@ -1671,8 +2547,9 @@ bool Vm::isModuleMemberPublic(const ObjString* name)
 
 Vm::Result Vm::callAndReturnValue(const Value& calle, Value* values, int argCount)
 {
+	TRY_RESERVE_STACK(static_cast<size_t>(argCount) + 1);
 	int numberOfValuesToPopOffExceptArgs = 0;
-	if (calle.isObj() && (calle.as.obj->isClass() || calle.as.obj->isBoundFunction()))
+	if (calle.isObj() && (calle.asObj()->isClass() || calle.asObj()->isBoundFunction()))
 	{
 		numberOfValuesToPopOffExceptArgs = 1;
 		TRY_PUSH(calle);
@@ -1690,20 +2567,20 @@ Vm::Result Vm::callAndReturnValue(const Value& calle, Value* values, int argCoun
 		// Make this check inside callValue, because this is error prone.
 		auto shouldCallRun = true;
 
-		if (calle.as.obj->isClass())
+		if (calle.asObj()->isClass())
 		{
-			auto optInitializer = calle.as.obj->asClass()->fields.get(m_initString);
+			auto optInitializer = calle.asObj()->asClass()->fields.get(m_initString);
 			if ((optInitializer.has_value() == false)
-				|| (optInitializer->isObj() && optInitializer->as.obj->isNativeFunction()))
+				|| (optInitializer->isObj() && optInitializer->asObj()->isNativeFunction()))
 			{
 				shouldCallRun = false;
 			}
 		}
-		else if (calle.as.obj->isNativeFunction())
+		else if (calle.asObj()->isNativeFunction())
 		{
 			shouldCallRun = false;
 		}
-		else if (calle.as.obj->isBoundFunction() && calle.as.obj->asBoundFunction()->callable->isNativeFunction())
+		else if (calle.asObj()->isBoundFunction() && calle.asObj()->asBoundFunction()->callable->isNativeFunction())
 		{
 			shouldCallRun = false;
 		}
@@ -1734,7 +2611,9 @@ Vm::Result Vm::throwErrorWithMsgImplementation(ObjClass* class_, const char* for
 	const auto message = formatToTempBuffer(format, args);
 
 	const auto string = m_allocator->allocateString(message);
-	instance->fields.set(m_msgString, Value(string));
+	TRY_PUSH(Value(string)); // GC
+	setInstanceField(instance, m_msgString, Value(string));
+	m_stack.pop();
 	m_stack.pop();
 	return throwValue(Value(instance));
 }
@@ -1771,6 +2650,8 @@ Vm::Result Vm::throwTypeErrorExpectedFound(ObjClass* expected, const Value& foun
 
 Vm::Result Vm::equals()
 {
+	flattenRope(m_stack.peek(1));
+	flattenRope(m_stack.peek(0));
 	auto a = m_stack.peek(1), b = m_stack.peek(0);
 	auto returnValue = [this](bool value)
 	{
@@ -1780,42 +2661,50 @@ Vm::Result Vm::equals()
 		return Result::ok();
 	};
 
-	if (a.isInt() && a.isFloat())
-		return returnValue(a.asInt() == a.asFloat());
-
-	if (a.isFloat() && b.isInt())
-		return returnValue(a.asFloat() == static_cast<Float>(b.asInt()));
-
-	if (a.isInt() && b.isInt())
-		return returnValue(a.asInt() == b.asInt());
+	if (const auto result = primitiveEquals(a, b); result.has_value())
+		return returnValue(*result);
 
-	if (a.isFloat() && b.isFloat())
-		return returnValue(a.asFloat() == b.asFloat());
+	auto class_ = getClass(a);
+	const auto method = class_.has_value() ? specialMethod(*class_, SpecialMethod::Eq) : Value::null();
+	if (method.isNull() == false)
+	{
+		// The arguments can't be on the stack, because it might grow.
+		Value arguments[] = { a, b };
+		TRY(callFromVmAndReturnValue(method, arguments, 2));
+		const auto result = m_stack.top();
+		m_stack.pop();
+		if (result.isBool() == false)
+			TRY(throwTypeErrorExpectedFound(m_boolType, result));
+		return returnValue(result.asBool());
+	}
 
-	if (a.isNull() && b.isNull())
-		return returnValue(true);
-	
-	if (a.isBool() && b.isBool())
-		return returnValue(a.asBool() == b.asBool());
+	return returnValue(b.isObj() && (a.asObj() == b.asObj()));
+}
 
-	if (a.isObj())
+ObjString* Vm::joinStrings(const Value* parts, size_t count)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < count; i++)
 	{
-		const auto aObj = a.asObj();
-		const auto bObj = a.asObj();
-
-		const auto method = getMethod(a, m_eqString);
-		if (method.has_value())
-		{
-			TRY(callFromVmAndReturnValue(*method, m_stack.topPtr - 2));
-			if (m_stack.top().isBool() == false)
-				TRY(throwTypeErrorExpectedFound(m_boolType, m_stack.top()));
-			return Result::ok();
-		}
+		const auto& part = parts[i];
+		if (part.isObj() && (part.asObj()->isString() || part.asObj()->isRope()))
+			size += ObjRope::stringSize(part.asObj());
+	}
 
-		return returnValue((a.type == b.type) && (aObj == bObj));
+	std::string chars;
+	chars.reserve(size);
+	size_t length = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		StringBuilder::append(chars, length, parts[i]);
 	}
+	return m_allocator->allocateString(chars, length);
+}
 
-	return returnValue(false);
+void Vm::flattenRope(Value& value)
+{
+	if (value.isObj() && value.asObj()->isRope())
+		value = Value(m_allocator->flattenRope(value.asObj()->asRope()));
 }
 
 Vm::Result Vm::callFromVmAndReturnValue(const Value& calle, Value* values, int argCount)
@@ -1823,7 +2712,11 @@ Vm::Result Vm::callFromVmAndReturnValue(const Value& calle, Value* values, int a
 	TRY(pushDummyCallFrame());
 	const auto result = callAndReturnValue(calle, values, argCount);
 	if (result.type == ResultType::Exception)
-		TRY(throwValue(result.exceptionValue));
+	{
+		// The frames above the dummy frame were already unwound.
+		popCallStack();
+		return throwValue(result.exceptionValue);
+	}
 	TRY(result);
 	popCallStack();
 	return Result::ok();
@@ -1844,6 +2737,10 @@ void Vm::mark(Vm* vm, Allocator& allocator)
 		allocator.addObj(vm->obj);
 	ADD(m_listType);
 	ADD(m_dictType);
+	ADD(m_dictIteratorType);
+	ADD(m_rangeType);
+	ADD(m_rangeIteratorType);
+	ADD(m_stringBuilderType);
 	ADD(m_numberType);
 	ADD(m_intType);
 	ADD(m_floatType);
@@ -1858,21 +2755,35 @@ void Vm::mark(Vm* vm, Allocator& allocator)
 	ADD(m_zeroDivisionErrorType);
 #undef ADD
 
-	allocator.addHashTable(vm->m_builtins);
+	allocator.addGlobals(vm->m_builtins);
 	for (const auto& frame : vm->m_callStack)
 	{
 		if (frame.callable != nullptr)
 			allocator.addObj(frame.callable);
 	}
 
-	for (auto upvalue : vm->m_openUpvalues)
+	for (auto upvalue = vm->m_openUpvalues; upvalue != nullptr; upvalue = upvalue->next)
 	{
 		allocator.addObj(upvalue);
 	}
+
+	// The inline caches are cleared when the functions are marked.
+#ifdef VOXL_DEBUG_PRINT_INLINE_CACHE_STATS
+	// Keep the functions alive so their stats can be printed.
+	for (const auto function : vm->m_functionsWithInlineCaches)
+	{
+		allocator.addObj(function);
+	}
+#endif
 }
 
 uint32_t Vm::readUint32()
 {
+#ifdef VOXL_PREDECODED_BYTECODE
+	uint32_t value = *m_instructionPointer;
+	m_instructionPointer++;
+	return value;
+#else
 	uint32_t value = readUint8();
 	for (int i = 0; i < 3; i++)
 	{
@@ -1880,6 +2791,7 @@ uint32_t Vm::readUint32()
 		value |= static_cast<uint32_t>(readUint8());
 	}
 	return value;
+#endif
 }
 
 Vm::Result Vm::Result::ok()
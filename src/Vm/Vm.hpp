@@ -2,7 +2,7 @@
 
 #include <Allocator.hpp>
 #include <ByteCode.hpp>
-#include <StaticStack.hpp>
+#include <Stack.hpp>
 #include <Parsing/Scanner.hpp>
 #include <Parsing/Parser.hpp>
 #include <Compiling/Compiler.hpp>
@@ -32,7 +32,7 @@ public:
 	// Order members to reduce the size.
 	struct CallFrame
 	{
-		const uint8_t* instructionPointerBeforeCall;
+		const CodeUnit* instructionPointerBeforeCall;
 		Value* values;
 		ObjUpvalue** upvalues;
 		Obj* callable;
@@ -40,13 +40,6 @@ public:
 		bool isInitializer;
 	};
 
-	struct ExceptionHandler
-	{
-		Value* stackTopPtrBeforeTry;
-		const uint8_t* handlerCodeLocation;
-		CallFrame* callFrame;
-	};
-
 	enum class ResultType
 	{
 		Ok,
@@ -99,34 +92,68 @@ public:
 	void defineNativeFunction(std::string_view name, NativeFunction function, int argCount);
 	void createModule(std::string_view name, NativeFunction moduleMain, void* data = nullptr);
 	void debugPrintStack();
+	void debugPrintInlineCacheStats();
 private:
 	Result run();
+	// Debug hooks executed before every instruction.
+	void beforeInstruction();
+	// Replaces the op of the currently executing instruction. Only valid for ops without operands.
+	void quicken(Op op);
 
 	uint32_t readUint32();
 	uint8_t readUint8();
 
 	Result fatalError(const char* format, ...);
+	// Grow the value stack and update the pointers into it. Return false if the maximum size would be exceeded.
+	bool growStack(size_t freeSpace);
 	Result callObjFunction(ObjFunction* function, int argCount, int numberOfValuesToPopOffExceptArgs, bool isInitializer);
 	Result callValue(Value value, int argCount, int numberOfValuesToPopOffExceptArgs, bool isInitializer = false);
 	// Not using const Value& becuase then get would need to be const and to do this getField would need to be const
 	// so it would just need to be copy pasted. Or it could reutrn an index.
 	std::optional<Value> atField(Value& value, ObjString* fieldName);
 	std::optional<Value> getMethod(Value& value, ObjString* methodName);
+	// Sets a field of the class and updates the resolved fields of its subclasses.
+	void setClassField(ObjClass* class_, ObjString* fieldName, const Value& value);
+	void setResolvedField(ObjClass* class_, ObjString* fieldName, const Value& value);
+	void inherit(ObjClass* class_, ObjClass* superclass);
+	// Returns the special method of the class or null if it isn't defined. Resolves the methods again if a class was
+	// modified since the last call.
+	const Value& specialMethod(ObjClass& class_, SpecialMethod method);
 	Result setField(const Value& lhs, ObjString* fieldName, const Value& rhs);
+	std::optional<Value&> atInstanceField(ObjInstance* instance, const ObjString* fieldName);
+	// The value and the instance have to be reachable because this might allocate a new shape.
+	void setInstanceField(ObjInstance* instance, ObjString* fieldName, const Value& value);
+	void convertToDictionaryMode(ObjInstance* instance);
+	InlineCache& readInlineCache();
+	// Returns nullptr if the value's fields can't be cached.
+	const void* inlineCacheKey(const Value& value);
+	// Same as getField and setField, but first check the cache and update it on a miss.
+	Result getFieldCached(InlineCache& cache, Value& value, ObjString* fieldName);
+	Result setFieldCached(InlineCache& cache, const Value& lhs, ObjString* fieldName, const Value& rhs);
+	// Calls the method without creating a bound function. The receiver is below the arguments on the stack.
+	Result invoke(InlineCache& cache, ObjString* methodName, int argCount);
+	// Same as invoke, but without a cache. Used by ops that only call methods on uncommon paths.
+	Result callMethod(ObjString* methodName, int argCount);
 	// Returns on stack.
 	Result getField(Value& value, ObjString* fieldName);
 	Result throwValue(const Value& value);
 	std::optional<ObjClass&> getClass(const Value& value);
 	std::optional<Value&> atGlobal(ObjString* name);
 	ResultWithValue getGlobal(ObjString* name);
-	Result setGlobal(ObjString* name, Value& value);
+	// Called when the global in the slot is not defined. The index of the builtin is cached in the slot.
+	ResultWithValue getBuiltin(Globals::Slot& slot);
 	// If Result::Ok then on return Module is TOS.
 	Result importModule(ObjString* name);
 	Result importAllFromModule(ObjModule* module);
 	Vm::Result pushDummyCallFrame();
 	void popCallStack();
+	// Returns the open upvalue pointing to location creating it if it doesn't exist.
+	ObjUpvalue* captureUpvalue(Value* location);
+	// Closes the open upvalues pointing to values at or above location.
+	void closeUpvalues(const Value* location);
 	static bool isModuleMemberPublic(const ObjString* name);
 	// The call frame has to be either a native function or a dummy call frame before calling. Returns on the stack.
+	// The calle and values can't be on the stack, because it might grow.
 	Result callAndReturnValue(const Value& calle, Value* values = nullptr, int argCount = 0);
 	// Returns on the stack.
 	Result callFromVmAndReturnValue(const Value& calle, Value* values = nullptr, int argCount = 0);
@@ -137,6 +164,14 @@ private:
 	Result throwTypeErrorExpectedFound(ObjClass* expected, const Value& found);
 	// Takes arguments and returns the value on the stack.
 	Result equals();
+	// Compares values that can't overload $eq without touching the stack. Strings are interned so they are equal only if
+	// they are the same object. Returns nullopt if the lhs is an object that might overload $eq, then equals has to be used.
+	static std::optional<bool> primitiveEquals(const Value& a, const Value& b);
+	// Replaces a rope with its flattened string. Has to be called before accessing the characters of a value that
+	// might be a rope. The value has to be reachable.
+	void flattenRope(Value& value);
+	// Formats the parts into a single string. Used by ConcatN. The parts have to be reachable.
+	ObjString* joinStrings(const Value* parts, size_t count);
 
 private:
 	static void mark(Vm* vm, Allocator& allocator);
@@ -151,14 +186,23 @@ public:
 
 	HashTable m_modules;
 
-	HashTable m_builtins;
-	// Don't use directly use getGlobal() and setGlobal() instead.
-	HashTable* m_globals;
-	const uint8_t* m_instructionPointer;
+	Globals m_builtins;
+	// Don't use directly use getGlobal() instead.
+	Globals* m_globals;
+	// The constant pool of the function of the current frame.
+	const Value* m_constants;
+	const CodeUnit* m_instructionPointer;
 	
-	StaticStack<Value, 1024> m_stack;
-	StaticStack<CallFrame, 128> m_callStack;
-	StaticStack<ExceptionHandler, 128> m_exceptionHandlers;
+	// The value stack only grows when a function is called, so pointers into it are valid until the current function
+	// calls another function. A call of a voxl function makes sure there is space for ByteCode::maxStackSize values
+	// and FRAME_STACK_SLACK values the vm pushes temporarily while executing instructions. A call of a native function
+	// makes sure there is at least FRAME_STACK_SPACE free space.
+	static constexpr size_t FRAME_STACK_SPACE = 256;
+	static constexpr size_t FRAME_STACK_SLACK = 8;
+	static constexpr size_t MAX_STACK_SIZE = 1024 * 1024;
+	static constexpr size_t MAX_CALL_STACK_SIZE = 64 * 1024;
+	Stack<Value, MAX_STACK_SIZE> m_stack;
+	Stack<CallFrame, MAX_CALL_STACK_SIZE> m_callStack;
 	size_t m_finallyBlockDepth;
 	Scanner* m_scanner;
 	Parser* m_parser;
@@ -169,7 +213,12 @@ public:
 	ErrorReporter* m_errorReporter;
 	const SourceInfo* m_sourceInfo;
 
-	std::vector<ObjUpvalue*> m_openUpvalues;
+	// Linked list of the open upvalues sorted from the highest stack location to the lowest. There is at most one
+	// upvalue for each location.
+	ObjUpvalue* m_openUpvalues;
+
+	// Only used if VOXL_DEBUG_PRINT_INLINE_CACHE_STATS is defined.
+	std::vector<ObjFunction*> m_functionsWithInlineCaches;
 
 	ObjString* m_initString;
 	ObjString* m_addString;
@@ -185,12 +234,20 @@ public:
 	ObjString* m_setIndexString;
 	ObjString* m_eqString;
 	ObjString* m_strString;
+	ObjString* m_iterString;
+	ObjString* m_nextString;
 	ObjString* m_emptyString;
 	ObjString* m_msgString;
+	// Names of the methods in ObjClass::specialMethods.
+	ObjString* m_specialMethodNames[ObjClass::SPECIAL_METHOD_COUNT];
 
 	ObjClass* m_listType;
 	ObjClass* m_listIteratorType;
 	ObjClass* m_dictType;
+	ObjClass* m_dictIteratorType;
+	ObjClass* m_rangeType;
+	ObjClass* m_rangeIteratorType;
+	ObjClass* m_stringBuilderType;
 	ObjClass* m_typeType;
 	ObjClass* m_numberType;
 	ObjClass* m_intType;
@@ -206,4 +263,44 @@ public:
 	Allocator::MarkingFunctionHandle m_rootMarkingFunctionHandle;
 };
 
+inline std::optional<bool> Vm::primitiveEquals(const Value& a, const Value& b)
+{
+	if (a.isInt())
+	{
+		if (b.isInt())
+			return a.asInt() == b.asInt();
+		if (b.isFloat())
+			return static_cast<Float>(a.asInt()) == b.asFloat();
+		return false;
+	}
+
+	if (a.isFloat())
+	{
+		if (b.isFloat())
+			return a.asFloat() == b.asFloat();
+		if (b.isInt())
+			return a.asFloat() == static_cast<Float>(b.asInt());
+		return false;
+	}
+
+	if (a.isObj() == false)
+	{
+		if (a.isBool())
+			return b.isBool() && (a.asBool() == b.asBool());
+		return b.isNull();
+	}
+
+	if (a.asObj()->isString())
+	{
+		if (b.isObj() == false)
+			return false;
+		// A rope might have the same characters.
+		if (b.asObj()->isRope())
+			return std::nullopt;
+		return a.asObj() == b.asObj();
+	}
+
+	return std::nullopt;
+}
+
 }
\ No newline at end of file
@@ -132,7 +132,7 @@ static void iteratorTest()
 	else if (strcmp(key->chars, expectedKey) == 0) \
 	{ \
 		ASSERT_TRUE(value.isInt()); \
-		ASSERT_EQ(value.as.intNumber, expectedValue); \
+		ASSERT_EQ(value.asInt(), expectedValue); \
 		count++; \
 	}
 	auto count = 0;
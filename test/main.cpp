@@ -64,6 +64,31 @@ std::pair<std::string_view, std::string_view> tests[] = {
 	{ "dict", "21" },
 	{ "import_all_from_native_module", "123456" },
 	{ "lambda_closure", "2" },
+	{ "instance_shapes", "12null345612891011" },
+	{ "inline_cache_invalidation", "aaaaabcbd123ce" },
+	{ "invoke", "433106" },
+	{ "global_slots", "a12b012dd" },
+	{ "quickening", "370.751.5114truefalsetruefalse9800" },
+	{ "superinstructions", "45553433.53bcacad" },
+	{ "local_assignments", "22.5519122422231.52.520.51.5242.53.512ab" },
+	{ "deep_recursion", "500050002deep3000" },
+	{ "tail_calls", "200000false15627n" },
+	{ "shared_upvalues", "2015207" },
+	{ "exception_tables", "retthrown13010a" },
+	{ "for_iter", "12123a1a6199" },
+	{ "range", "012344512252466923st7802" },
+	{ "handle_scopes", "value1999value0value19992000" },
+	{ "constant_pools", "1.5a2.5a1.57cax2999" },
+	{ "special_methods", "5true206truefalsesub" },
+	{ "resolved_methods", "acahagba" },
+	{ "subclass_checks", "cbdain?caught" },
+	{ "equality", "truetruefalsetruefalsetruefalsetruefalsetruefalsea" },
+	{ "ropes", "4000truetruetruetruefoundStringlog entry 1 with enough text to be longer than the shortest rope in the vm" },
+	{ "string_builder", "3434truea line that is long enough to be a rope when it is concatenated!\nnull" },
+	{ "concat_n", "hello (ツ) number 1 2.5 null27trueabctrue2890" },
+	{ "big_ints", "140737488355328-140737488355329truetruetrue281474976710656-1407374883553281125899906842623IntIntabovemaxstring" },
+	{ "wide_frame", "599602599" },
+	{ "weak_subclasses", "2" },
 };
 
 void testFailed(std::string_view name)